@@ -44,13 +44,14 @@ class LED {
   int getG() { return (int)(max(g,w)*a); }
   int getB() { return (int)(max(b,w)*a); }
   
-  LED operator = (LED const &other)
+  LED& operator = (LED const &other)
   {
       r = constrain(other.r, 0, 255);
       g = constrain(other.g, 0, 255);
       b = constrain(other.b, 0, 255);
       w = constrain(other.w, 0, 255);
       a = constrain(other.a, 0, 1);
+      return *this;
   }
   
   void norm() {
@@ -0,0 +1,222 @@
+#ifndef BAKED_LAYOUT_H
+#define BAKED_LAYOUT_H
+
+// figures declared as constexpr arrays of segments. the program builds its Segments from them
+// at runtime, and with -DBAKED_LAYOUT also bakes every LED's position, relative coordinate,
+// segment and type into a static table at compile time (BAKE_FIGURE), so that a fixed
+// installation neither computes the layout at startup nor walks the segments while shading.
+//
+// the math below repeats Segment's set / set_length / get_pixel with constexpr sqrt, atan2
+// and sin / cos, in the same float and double steps, so the baked LEDs are where the
+// runtime ones are to the last bit or one
+
+#include <vector>
+
+struct BakedSegment
+{
+    float x;
+    float y;
+    float to_x;
+    float to_y;
+    int type = 0;
+};
+
+struct BakedPixel
+{
+    float x;
+    float y;
+    float u;        // x / width
+    float v;        // y / height
+    int segment;
+    int type;
+};
+
+template<int N> struct BakedTable
+{
+    static constexpr int size = N;
+    BakedPixel pixels[N > 0 ? N : 1];
+};
+
+// where the segments are, in the units and with the offset of the program's Segment
+struct BakedGeometry
+{
+    float pitch;        // distance_LED_in_cm
+    float offset_x;
+    float offset_y;
+    double pi;          // the PI the program computes its directions with
+};
+
+//////// CONSTEXPR MATH ////////
+
+constexpr double baked_pi = 3.14159265358979323846;
+
+constexpr double baked_abs(double x) {return x < 0 ? -x : x;}
+
+constexpr double baked_sqrt(double x)
+{
+    if (x <= 0)
+    {
+        return 0;
+    }
+    double r = x > 1 ? x : 1;
+    for (int i = 0; i < 200; i++)
+    {
+        double next = .5 * (r + x / r);
+        if (next >= r)
+        {
+            break;
+        }
+        r = next;
+    }
+    return r;
+}
+
+// series of sin and cos after reducing x to [-pi, pi]
+constexpr double baked_reduce(double x)
+{
+    while (x > baked_pi)
+    {
+        x -= 2 * baked_pi;
+    }
+    while (x < -baked_pi)
+    {
+        x += 2 * baked_pi;
+    }
+    return x;
+}
+
+constexpr double baked_sin(double x)
+{
+    x = baked_reduce(x);
+    double term = x, sum = x;
+    for (int k = 1; k < 30 && baked_abs(term) > 1e-18; k++)
+    {
+        term *= -x * x / ((2 * k) * (2 * k + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double baked_cos(double x)
+{
+    x = baked_reduce(x);
+    double term = 1, sum = 1;
+    for (int k = 1; k < 30 && baked_abs(term) > 1e-18; k++)
+    {
+        term *= -x * x / ((2 * k - 1) * (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+// halves the angle until the series converges fast: atan(t) = 2 atan(t / (1 + sqrt(1 + t^2)))
+constexpr double baked_atan(double t)
+{
+    if (baked_abs(t) > 1)
+    {
+        return (t > 0 ? baked_pi / 2 : -baked_pi / 2) - baked_atan(1 / t);
+    }
+    double scale = 1;
+    for (int h = 0; h < 3; h++)
+    {
+        t = t / (1 + baked_sqrt(1 + t * t));
+        scale *= 2;
+    }
+    double term = t, sum = t;
+    for (int k = 1; k < 40 && baked_abs(term) > 1e-18; k++)
+    {
+        term *= -t * t;
+        sum += term / (2 * k + 1);
+    }
+    return scale * sum;
+}
+
+constexpr double baked_atan2(double y, double x)
+{
+    if (x > 0)
+    {
+        return baked_atan(y / x);
+    }
+    if (x < 0)
+    {
+        return baked_atan(y / x) + (y >= 0 ? baked_pi : -baked_pi);
+    }
+    return y > 0 ? baked_pi / 2 : y < 0 ? -baked_pi / 2 : 0;
+}
+
+//////// BAKING ////////
+
+struct BakedPlacement
+{
+    float origin_x;
+    float origin_y;
+    double dir_cos;
+    double dir_sin;
+    int pixels;
+};
+
+// Segment(x, y, to_x, to_y) step by step
+constexpr BakedPlacement baked_place(const BakedSegment &segment, const BakedGeometry &geometry)
+{
+    float x = segment.x + geometry.offset_x;
+    float y = segment.y + geometry.offset_y;
+    float to_x = segment.to_x + geometry.offset_x;
+    float to_y = segment.to_y + geometry.offset_y;
+    float direction = 180. / geometry.pi * baked_atan2(y - to_y, to_x - x);
+    double turned = direction + 360.;
+    direction = turned >= 360. ? turned - 360. : turned;
+    float dx = to_x - x, dy = to_y - y;
+    float length = baked_sqrt((double)dx * dx + (double)dy * dy);
+    float count = (length + 1) / geometry.pitch;
+    BakedPlacement placement = {x, y, baked_cos(direction * geometry.pi / 180.), baked_sin(direction * geometry.pi / 180.), (int)(count + .5)};
+    return placement;
+}
+
+template<int S> constexpr int baked_pixel_count(const BakedSegment (&segments)[S], BakedGeometry geometry)
+{
+    int count = 0;
+    for (int s = 0; s < S; s++)
+    {
+        count += baked_place(segments[s], geometry).pixels;
+    }
+    return count;
+}
+
+template<int N, int S> constexpr BakedTable<N> bake(const BakedSegment (&segments)[S], BakedGeometry geometry, float width, float height)
+{
+    BakedTable<N> table = {};
+    int i = 0;
+    for (int s = 0; s < S; s++)
+    {
+        BakedPlacement placement = baked_place(segments[s], geometry);
+        for (int p = 0; p < placement.pixels; p++, i++)
+        {
+            float step = p * geometry.pitch;
+            BakedPixel &pixel = table.pixels[i];
+            pixel.x = placement.origin_x + step * placement.dir_cos;
+            pixel.y = placement.origin_y - step * placement.dir_sin;
+            pixel.u = pixel.x / width;
+            pixel.v = pixel.y / height;
+            pixel.segment = s;
+            pixel.type = segments[s].type;
+        }
+    }
+    return table;
+}
+
+// constexpr BakedTable<...> name holding every LED of the figure
+#define BAKE_FIGURE(name, segments, geometry, width, height) \
+    constexpr BakedTable<baked_pixel_count(segments, geometry)> name = bake<baked_pixel_count(segments, geometry)>(segments, geometry, width, height)
+
+// the same figure as runtime Segments, for the editor and whatever else changes the layout
+template<typename S, int N> std::vector<S> baked_segments(const BakedSegment (&figure)[N])
+{
+    std::vector<S> segments;
+    for (int s = 0; s < N; s++)
+    {
+        segments.push_back(S(figure[s].x, figure[s].y, figure[s].to_x, figure[s].to_y, figure[s].type));
+    }
+    return segments;
+}
+
+#endif
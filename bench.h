@@ -0,0 +1,349 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// small benchmark harness for make bench_led and the --bench mode of the programs (make bench).
+// micro-benchmarks are repeated until they ran for long enough and the median of the
+// repetitions is reported, frame benchmarks time a fixed number of frames and count the heap
+// allocations. results are written in the JSON layout of Google Benchmark (name, iterations,
+// real_time in ns) so its compare tools also work, --compare reads such a file back and
+// flags regressions
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+#define BENCH_MIN_TIME .1
+#define BENCH_REPETITIONS 5
+#define BENCH_DEFAULT_THRESHOLD .1
+#define BENCH_DEFAULT_FRAMES 600
+#define BENCH_WARMUP_FRAMES 10
+
+// with -DBENCH_COUNT_ALLOCATIONS (make bench, make alloc_check) every heap allocation of the
+// program goes through here and is counted, other builds keep the plain allocator
+std::atomic<long long> bench_allocations(0);
+
+#ifdef BENCH_COUNT_ALLOCATIONS
+
+const bool bench_counts_allocations = true;
+
+void* operator new(size_t size)
+{
+    bench_allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = malloc(size > 0 ? size : 1);
+    if (p == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {free(p);}
+void operator delete[](void *p) noexcept {free(p);}
+void operator delete(void *p, size_t size) noexcept {free(p);}
+void operator delete[](void *p, size_t size) noexcept {free(p);}
+
+#else
+
+const bool bench_counts_allocations = false;
+
+#endif
+
+// keeps the compiler from dropping a computation whose result is never used
+template<typename T> inline void bench_keep(T const &value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+inline double bench_now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct BenchResult
+{
+    std::string name;
+    long long iterations;
+    double ns;                  // per item
+    double per_second = -1;     // frames, only for frame benchmarks
+    double allocations = -1;    // per frame
+};
+
+// where a frame benchmark started
+struct BenchTimer
+{
+    double start;
+    long long allocations;
+    BenchTimer() : start(bench_now()), allocations(bench_allocations.load()) {}
+};
+
+// time and allocations of one stage summed over the frames, when frames run several stages
+struct BenchStage
+{
+    double elapsed = 0;
+    long long allocations = 0;
+    BenchTimer started;
+    void begin() {started = BenchTimer();}
+    void end()
+    {
+        elapsed += bench_now() - started.start;
+        allocations += bench_allocations.load() - started.allocations;
+    }
+};
+
+struct BenchSuite
+{
+    std::vector<BenchResult> results;
+    const char *filter = NULL;
+
+    // body(n) has to process n * items items
+    template<typename F> void run(const char *name, int items, F body)
+    {
+        if (filter != NULL && strstr(name, filter) == NULL)
+        {
+            return;
+        }
+        long long n = 1;
+        double elapsed = 0;
+        while (true)
+        {
+            double start = bench_now();
+            body(n);
+            elapsed = bench_now() - start;
+            if (elapsed > BENCH_MIN_TIME || n > (1LL << 40))
+            {
+                break;
+            }
+            n = elapsed > 1e-6 ? std::max(2 * n, (long long)(1.2 * n * BENCH_MIN_TIME / elapsed)) : 10 * n;
+        }
+        std::vector<double> times;
+        times.push_back(elapsed);
+        for (int r = 1; r < BENCH_REPETITIONS; r++)
+        {
+            double start = bench_now();
+            body(n);
+            times.push_back(bench_now() - start);
+        }
+        std::sort(times.begin(), times.end());
+        BenchResult result = {name, n * items, 1e9 * times[times.size() / 2] / (n * items)};
+        results.push_back(result);
+        printf("%-32s %14lld %12.3f ns\n", name, result.iterations, result.ns);
+    }
+
+    void add_frames(const char *name, BenchTimer &timer, int frames, int pixels)
+    {
+        add_frames(name, bench_now() - timer.start, bench_allocations.load() - timer.allocations, frames, pixels);
+    }
+
+    void add_frames(const char *name, BenchStage &stage, int frames, int pixels)
+    {
+        add_frames(name, stage.elapsed, stage.allocations, frames, pixels);
+    }
+
+    void add_frames(const char *name, double elapsed, long long allocations, int frames, int pixels)
+    {
+        BenchResult result = {name, frames, 1e9 * elapsed / ((double)frames * pixels)};
+        result.per_second = frames / elapsed;
+        result.allocations = bench_counts_allocations ? (double)allocations / frames : -1;
+        results.push_back(result);
+        printf("%-40s %8i pixels %10.1f frames/s %10.2f ns/pixel", name, pixels, result.per_second, result.ns);
+        if (result.allocations >= 0)
+        {
+            printf(" %8.2f allocations/frame", result.allocations);
+        }
+        printf("\n");
+    }
+
+    bool write_json(const char *path, const char *context)
+    {
+        FILE *file = fopen(path, "w");
+        if (file == NULL)
+        {
+            printf("could not write %s\n", path);
+            return false;
+        }
+        fprintf(file, "{\n\"context\": {\"executable\": \"%s\"},\n\"benchmarks\": [\n", context);
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            fprintf(file, "{\"name\": \"%s\", \"iterations\": %lld, \"real_time\": %.4f, \"cpu_time\": %.4f, \"time_unit\": \"ns\"",
+                    results[i].name.c_str(), results[i].iterations, results[i].ns, results[i].ns);
+            if (results[i].per_second >= 0)
+            {
+                fprintf(file, ", \"frames_per_second\": %.2f", results[i].per_second);
+            }
+            if (results[i].allocations >= 0)
+            {
+                fprintf(file, ", \"allocations_per_frame\": %.3f", results[i].allocations);
+            }
+            fprintf(file, "}%s\n", i + 1 < results.size() ? "," : "");
+        }
+        fprintf(file, "]\n}\n");
+        fclose(file);
+        return true;
+    }
+
+    // only understands the one benchmark per line layout written above
+    static bool read_json(const char *path, std::vector<BenchResult> &found)
+    {
+        FILE *file = fopen(path, "r");
+        if (file == NULL)
+        {
+            printf("could not read %s\n", path);
+            return false;
+        }
+        char line[512];
+        char name[256];
+        BenchResult result;
+        while (fgets(line, sizeof(line), file))
+        {
+            if (sscanf(line, "{\"name\": \"%255[^\"]\", \"iterations\": %lld, \"real_time\": %lf", name, &result.iterations, &result.ns) == 3)
+            {
+                result.name = name;
+                result.allocations = -1;
+                const char *allocations = strstr(line, "\"allocations_per_frame\": ");
+                if (allocations != NULL)
+                {
+                    result.allocations = atof(allocations + strlen("\"allocations_per_frame\": "));
+                }
+                found.push_back(result);
+            }
+        }
+        fclose(file);
+        return true;
+    }
+
+    // returns the number of benchmarks that got slower than the baseline by more than threshold
+    // or started to allocate more
+    int compare(const char *baseline_path, double threshold)
+    {
+        std::vector<BenchResult> baseline;
+        if (!read_json(baseline_path, baseline))
+        {
+            return -1;
+        }
+        int regressions = 0;
+        printf("\n%-32s %12s %12s %9s\n", "compared to baseline", "before ns", "now ns", "change");
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            for (size_t j = 0; j < baseline.size(); j++)
+            {
+                if (baseline[j].name != results[i].name || baseline[j].ns <= 0)
+                {
+                    continue;
+                }
+                double change = results[i].ns / baseline[j].ns - 1;
+                bool slower = change > threshold;
+                bool allocating = baseline[j].allocations >= 0 && results[i].allocations > baseline[j].allocations * (1 + threshold) + .5;
+                regressions += slower || allocating;
+                printf("%-32s %12.3f %12.3f %+8.1f %%%s%s\n", results[i].name.c_str(), baseline[j].ns, results[i].ns, 100 * change,
+                       slower ? "  REGRESSION" : "", allocating ? "  MORE ALLOCATIONS" : "");
+            }
+        }
+        return regressions;
+    }
+};
+
+// command line of the benchmarks: --bench [frames] --filter name --json out.json --compare baseline.json [threshold]
+// --alloc-check fails the run when any frame benchmark allocated after its warm-up frames
+struct BenchOptions
+{
+    int frames = 0;
+    bool alloc_check = false;
+    const char *filter = NULL;
+    const char *json = NULL;
+    const char *baseline = NULL;
+    double threshold = BENCH_DEFAULT_THRESHOLD;
+
+    void parse(int argc, char* argv[])
+    {
+        for (int a = 1; a < argc; a++)
+        {
+            if (!strcmp(argv[a], "--bench"))
+            {
+                frames = a + 1 < argc && atoi(argv[a + 1]) > 0 ? atoi(argv[++a]) : BENCH_DEFAULT_FRAMES;
+            }
+            else if (!strcmp(argv[a], "--alloc-check"))
+            {
+                if (!bench_counts_allocations)
+                {
+                    printf("--alloc-check needs a build with -DBENCH_COUNT_ALLOCATIONS (make alloc_check).\n");
+                    exit(1);
+                }
+                alloc_check = true;
+            }
+            else if (!strcmp(argv[a], "--filter") && a + 1 < argc)
+            {
+                filter = argv[++a];
+            }
+            else if (!strcmp(argv[a], "--json") && a + 1 < argc)
+            {
+                json = argv[++a];
+            }
+            else if (!strcmp(argv[a], "--compare") && a + 1 < argc)
+            {
+                baseline = argv[++a];
+                if (a + 1 < argc && atof(argv[a + 1]) > 0)
+                {
+                    threshold = atof(argv[++a]);
+                }
+            }
+        }
+    }
+
+    bool wanted(const char *name)
+    {
+        return filter == NULL || strstr(name, filter) != NULL;
+    }
+
+    // the exit code of the benchmark run
+    int finish(BenchSuite &suite, const char *context)
+    {
+        if (json != NULL && !suite.write_json(json, context))
+        {
+            return 1;
+        }
+        if (alloc_check)
+        {
+            int allocating = 0;
+            for (size_t i = 0; i < suite.results.size(); i++)
+            {
+                if (suite.results[i].allocations > 0)
+                {
+                    printf("%s allocates %.2f times per frame\n", suite.results[i].name.c_str(), suite.results[i].allocations);
+                    allocating++;
+                }
+            }
+            if (allocating > 0)
+            {
+                return 1;
+            }
+            printf("no allocations in steady state\n");
+        }
+        if (baseline != NULL)
+        {
+            int regressions = suite.compare(baseline, threshold);
+            if (regressions < 0)
+            {
+                return 1;
+            }
+            if (regressions > 0)
+            {
+                printf("%i benchmarks regressed by more than %g %%\n", regressions, 100 * threshold);
+                return 1;
+            }
+        }
+        return 0;
+    }
+};
+
+#endif
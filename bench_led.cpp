@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <cmath>
+#include <cstring>
+#include <SDL2/SDL.h>
+#include <vector>
+
+// the LED implementation under test, make bench_led LED_HEADER=other.h to compare a replacement
+#ifndef LED_HEADER
+#define LED_HEADER "LED_WS.h"
+#endif
+#include LED_HEADER
+#include "bench.h"
+
+#define BATCH 1024
+
+// micro-benchmarks of the LED color primitives, once on a single LED and once over a
+// batch of BATCH LEDs like a pattern walks its pixels. times are per call.
+//
+//  bench_led [--filter name] [--json out.json] [--compare baseline.json [threshold]]
+
+int main(int argc, char* argv[])
+{
+    BenchSuite suite;
+    BenchOptions options;
+    options.parse(argc, argv);
+    suite.filter = options.filter;
+
+    printf("LED primitives from %s\n", LED_HEADER);
+
+    // inputs spread over all hues, whites and lights a pattern would use
+    std::vector<LED> colors(BATCH);
+    std::vector<LED> others(BATCH);
+    std::vector<LED> batch(BATCH);
+    std::vector<Uint32> packed(BATCH);
+    for (int i = 0; i < BATCH; i++)
+    {
+        colors[i].setHWL(i * 360. / BATCH, (i % 7) / 10., ((i * 37) % BATCH) / (double)BATCH);
+        others[i].setHWL(i * 137.5, (i % 3) / 4., ((i * 11) % BATCH) / (double)BATCH);
+    }
+
+    //////////// SCALAR ////////////
+    suite.run("setHue/scalar", 1, [&](long long n)
+    {
+        LED L;
+        for (long long i = 0; i < n; i++)
+        {
+            L.setHue(i * .37);
+            bench_keep(L);
+        }
+    });
+    suite.run("setHWL/scalar", 1, [&](long long n)
+    {
+        LED L;
+        for (long long i = 0; i < n; i++)
+        {
+            L.setHWL(i * .37, .2, .8);
+            bench_keep(L);
+        }
+    });
+    suite.run("mix/scalar", 1, [&](long long n)
+    {
+        for (long long i = 0; i < n; i++)
+        {
+            LED L = colors[i % BATCH];
+            L.mix(others[i % BATCH], .5);
+            bench_keep(L);
+        }
+    });
+    suite.run("mix_shitty/scalar", 1, [&](long long n)
+    {
+        for (long long i = 0; i < n; i++)
+        {
+            LED L = colors[i % BATCH];
+            L.mix_shitty(others[i % BATCH], .3);
+            bench_keep(L);
+        }
+    });
+    suite.run("operator+/scalar", 1, [&](long long n)
+    {
+        for (long long i = 0; i < n; i++)
+        {
+            LED L = colors[i % BATCH] + others[i % BATCH];
+            bench_keep(L);
+        }
+    });
+    suite.run("operator*/scalar", 1, [&](long long n)
+    {
+        for (long long i = 0; i < n; i++)
+        {
+            LED L = .7 * colors[i % BATCH];
+            bench_keep(L);
+        }
+    });
+    suite.run("getHue/scalar", 1, [&](long long n)
+    {
+        for (long long i = 0; i < n; i++)
+        {
+            float hue = colors[i % BATCH].getHue();
+            bench_keep(hue);
+        }
+    });
+    suite.run("LEDColor/scalar", 1, [&](long long n)
+    {
+        for (long long i = 0; i < n; i++)
+        {
+            Uint32 color = LEDColor(colors[i % BATCH]);
+            bench_keep(color);
+        }
+    });
+    suite.run("LEDColor_alpha/scalar", 1, [&](long long n)
+    {
+        for (long long i = 0; i < n; i++)
+        {
+            Uint32 color = LEDColor(colors[i % BATCH], .5);
+            bench_keep(color);
+        }
+    });
+
+    //////////// BATCH ////////////
+    suite.run("setHue/batch", BATCH, [&](long long n)
+    {
+        for (long long k = 0; k < n; k++)
+        {
+            for (int i = 0; i < BATCH; i++)
+            {
+                batch[i].setHue(i * .37 + k);
+            }
+            bench_keep(batch[0]);
+        }
+    });
+    suite.run("setHWL/batch", BATCH, [&](long long n)
+    {
+        for (long long k = 0; k < n; k++)
+        {
+            for (int i = 0; i < BATCH; i++)
+            {
+                batch[i].setHWL(i * .37 + k, .2, .8);
+            }
+            bench_keep(batch[0]);
+        }
+    });
+    suite.run("mix/batch", BATCH, [&](long long n)
+    {
+        for (long long k = 0; k < n; k++)
+        {
+            for (int i = 0; i < BATCH; i++)
+            {
+                batch[i] = colors[i];
+                batch[i].mix(others[i], .5);
+            }
+            bench_keep(batch[0]);
+        }
+    });
+    suite.run("mix_shitty/batch", BATCH, [&](long long n)
+    {
+        for (long long k = 0; k < n; k++)
+        {
+            for (int i = 0; i < BATCH; i++)
+            {
+                batch[i] = colors[i];
+                batch[i].mix_shitty(others[i], .3);
+            }
+            bench_keep(batch[0]);
+        }
+    });
+    suite.run("operator+/batch", BATCH, [&](long long n)
+    {
+        for (long long k = 0; k < n; k++)
+        {
+            for (int i = 0; i < BATCH; i++)
+            {
+                batch[i] = colors[i] + others[i];
+            }
+            bench_keep(batch[0]);
+        }
+    });
+    suite.run("operator*/batch", BATCH, [&](long long n)
+    {
+        for (long long k = 0; k < n; k++)
+        {
+            for (int i = 0; i < BATCH; i++)
+            {
+                batch[i] = .7 * colors[i];
+            }
+            bench_keep(batch[0]);
+        }
+    });
+    suite.run("getHue/batch", BATCH, [&](long long n)
+    {
+        for (long long k = 0; k < n; k++)
+        {
+            float sum = 0;
+            for (int i = 0; i < BATCH; i++)
+            {
+                sum += colors[i].getHue();
+            }
+            bench_keep(sum);
+        }
+    });
+    suite.run("LEDColor/batch", BATCH, [&](long long n)
+    {
+        for (long long k = 0; k < n; k++)
+        {
+            for (int i = 0; i < BATCH; i++)
+            {
+                packed[i] = LEDColor(colors[i]);
+            }
+            bench_keep(packed[0]);
+        }
+    });
+    suite.run("LEDColor_alpha/batch", BATCH, [&](long long n)
+    {
+        for (long long k = 0; k < n; k++)
+        {
+            for (int i = 0; i < BATCH; i++)
+            {
+                packed[i] = LEDColor(colors[i], .5);
+            }
+            bench_keep(packed[0]);
+        }
+    });
+
+    return options.finish(suite, LED_HEADER);
+}
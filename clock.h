@@ -0,0 +1,58 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <chrono>
+
+// pattern steps per second, one step is what used to be one rendered frame at 60 Hz
+#define SIM_RATE 60.
+// after a stall (window dragged, debugger, ...) skip ahead instead of catching up forever
+#define SIM_MAX_STEPS_PER_FRAME 10
+
+// fixed timestep clock: wall time is accumulated and handed out in whole simulation steps,
+// the remainder is the interpolation factor between the last two steps
+struct SimClock
+{
+    double step = 1. / SIM_RATE;
+    double accumulator = 0;
+    double last = -1;
+    long ticks = 0;
+    int skipped = 0;    // steps thrown away by the last advance
+
+    static double now()
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // returns how many simulation steps to run for the wall time passed since the last call
+    int advance(double wall_time)
+    {
+        if (last < 0)
+        {
+            last = wall_time;
+        }
+        accumulator += wall_time - last;
+        last = wall_time;
+
+        int steps = 0;
+        while (accumulator >= step)
+        {
+            accumulator -= step;
+            steps++;
+        }
+        skipped = 0;
+        if (steps > SIM_MAX_STEPS_PER_FRAME)
+        {
+            skipped = steps - SIM_MAX_STEPS_PER_FRAME;
+            steps = SIM_MAX_STEPS_PER_FRAME;
+        }
+        ticks += steps;
+        return steps;
+    }
+
+    float alpha() {return accumulator / step;}
+
+    // continuous time in steps, what the shaders get instead of a frame counter
+    double time() {return ticks + alpha();}
+};
+
+#endif
@@ -0,0 +1,252 @@
+#ifndef GOLDEN_H
+#define GOLDEN_H
+
+// golden frames, the safety net for rewriting the shaders. every program renders a fixed
+// number of frames of each layout and pattern from a fixed seed and keeps per frame a
+// checksum of all colors, the sum of every channel and a few sample LEDs:
+//
+//  --golden-record golden.txt      on a commit whose output is known to be right
+//  --golden-check golden.txt [tol] after a change, exits with 1 on a mismatch
+//
+// a frame passes when its checksum is identical, or when the channel means and all samples
+// are within tol (0 to 255, per channel) of the recorded ones. that way reordered float math
+// passes while a shader that went wrong does not
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#define GOLDEN_SEED 1
+#define GOLDEN_DEFAULT_FRAMES 120
+#define GOLDEN_DEFAULT_TOLERANCE 2
+#define GOLDEN_SAMPLES 8
+#define GOLDEN_MAX_REPORTED 5
+
+struct GoldenFrame
+{
+    unsigned checksum;
+    int pixels;
+    long long sum[3];
+    int index[GOLDEN_SAMPLES];
+    int sample[GOLDEN_SAMPLES][3];
+};
+
+// spread over the layout and moving from frame to frame, but always the same for a given frame
+inline int golden_sample_index(int i, int frame, int pixels)
+{
+    int stride = max(pixels / GOLDEN_SAMPLES, 1);
+    return min(i * stride + (frame * 7919 + i * 104729) % stride, pixels - 1);
+}
+
+struct GoldenRun
+{
+    bool recording = false;
+    const char *path = NULL;
+    int frames = GOLDEN_DEFAULT_FRAMES;
+    int tolerance = GOLDEN_DEFAULT_TOLERANCE;
+    std::map<std::string, GoldenFrame> computed;
+
+    bool enabled() {return path != NULL;}
+
+    void parse(int argc, char* argv[])
+    {
+        for (int a = 1; a < argc; a++)
+        {
+            if ((!strcmp(argv[a], "--golden-record") || !strcmp(argv[a], "--golden-check")) && a + 1 < argc)
+            {
+                recording = !strcmp(argv[a], "--golden-record");
+                path = argv[++a];
+                if (!recording && a + 1 < argc && argv[a + 1][0] != '-')
+                {
+                    tolerance = atoi(argv[++a]);
+                }
+            }
+            else if (!strcmp(argv[a], "--golden-frames") && a + 1 < argc)
+            {
+                frames = max(atoi(argv[++a]), 1);
+            }
+        }
+    }
+
+    static std::string key(const char *name, int frame)
+    {
+        char line[128];
+        snprintf(line, sizeof(line), "%s %i", name, frame);
+        return line;
+    }
+
+    void add(const char *name, int frame, std::vector<Pixel> &P)
+    {
+        GoldenFrame golden;
+        golden.checksum = 2166136261u;
+        golden.pixels = P.size();
+        golden.sum[0] = golden.sum[1] = golden.sum[2] = 0;
+        for (int p = 0; p < P.size(); p++)
+        {
+            int rgb[3] = {P[p].L.getR(), P[p].L.getG(), P[p].L.getB()};
+            for (int c = 0; c < 3; c++)
+            {
+                golden.checksum = (golden.checksum ^ (unsigned)(rgb[c] & 0xff)) * 16777619u;
+                golden.sum[c] += rgb[c];
+            }
+        }
+        for (int i = 0; i < GOLDEN_SAMPLES; i++)
+        {
+            golden.index[i] = P.empty() ? 0 : golden_sample_index(i, frame, P.size());
+            for (int c = 0; c < 3; c++)
+            {
+                golden.sample[i][c] = P.empty() ? 0 : c == 0 ? P[golden.index[i]].L.getR() : c == 1 ? P[golden.index[i]].L.getG() : P[golden.index[i]].L.getB();
+            }
+        }
+        computed[key(name, frame)] = golden;
+    }
+
+    bool write()
+    {
+        FILE *file = fopen(path, "w");
+        if (file == NULL)
+        {
+            printf("could not write %s\n", path);
+            return false;
+        }
+        fprintf(file, "# golden frames, seed %i: case frame checksum pixels sum_r sum_g sum_b {index r g b}\n", GOLDEN_SEED);
+        for (std::map<std::string, GoldenFrame>::iterator it = computed.begin(); it != computed.end(); ++it)
+        {
+            GoldenFrame &golden = it->second;
+            fprintf(file, "%s %08x %i %lld %lld %lld", it->first.c_str(), golden.checksum, golden.pixels, golden.sum[0], golden.sum[1], golden.sum[2]);
+            for (int i = 0; i < GOLDEN_SAMPLES; i++)
+            {
+                fprintf(file, " %i %i %i %i", golden.index[i], golden.sample[i][0], golden.sample[i][1], golden.sample[i][2]);
+            }
+            fprintf(file, "\n");
+        }
+        fclose(file);
+        printf("recorded %i golden frames to %s\n", (int)computed.size(), path);
+        return true;
+    }
+
+    static bool read(const char *path, std::map<std::string, GoldenFrame> &found)
+    {
+        FILE *file = fopen(path, "r");
+        if (file == NULL)
+        {
+            printf("could not read %s\n", path);
+            return false;
+        }
+        char line[1024];
+        char name[128];
+        int frame, used;
+        while (fgets(line, sizeof(line), file))
+        {
+            GoldenFrame golden;
+            if (line[0] == '#' || sscanf(line, "%127s %i %x %i %lld %lld %lld%n", name, &frame, &golden.checksum, &golden.pixels,
+                                         &golden.sum[0], &golden.sum[1], &golden.sum[2], &used) < 7)
+            {
+                continue;
+            }
+            char *rest = line + used;
+            for (int i = 0; i < GOLDEN_SAMPLES; i++)
+            {
+                int n = 0;
+                sscanf(rest, "%i %i %i %i%n", &golden.index[i], &golden.sample[i][0], &golden.sample[i][1], &golden.sample[i][2], &n);
+                rest += n;
+            }
+            found[key(name, frame)] = golden;
+        }
+        fclose(file);
+        return true;
+    }
+
+    // returns the number of frames that differ by more than the tolerance or were recorded
+    // but not rendered this time
+    int check()
+    {
+        std::map<std::string, GoldenFrame> expected;
+        if (!read(path, expected))
+        {
+            return -1;
+        }
+        int failed = 0, exact = 0;
+        for (std::map<std::string, GoldenFrame>::iterator it = computed.begin(); it != computed.end(); ++it)
+        {
+            std::map<std::string, GoldenFrame>::iterator golden = expected.find(it->first);
+            const char *problem = NULL;
+            char detail[128] = "";
+            GoldenFrame &now = it->second;
+            if (golden == expected.end())
+            {
+                problem = "not recorded";
+            }
+            else if (golden->second.checksum == now.checksum && golden->second.pixels == now.pixels)
+            {
+                exact++;
+                continue;
+            }
+            else if (golden->second.pixels != now.pixels)
+            {
+                problem = "number of LEDs changed";
+            }
+            else
+            {
+                for (int c = 0; c < 3 && problem == NULL; c++)
+                {
+                    double mean = (double)(now.sum[c] - golden->second.sum[c]) / max(now.pixels, 1);
+                    if (fabs(mean) > tolerance)
+                    {
+                        problem = "channel mean";
+                        snprintf(detail, sizeof(detail), " (channel %i off by %.2f)", c, mean);
+                    }
+                }
+                for (int i = 0; i < GOLDEN_SAMPLES && problem == NULL; i++)
+                {
+                    for (int c = 0; c < 3 && problem == NULL; c++)
+                    {
+                        int off = now.sample[i][c] - golden->second.sample[i][c];
+                        if (abs(off) > tolerance)
+                        {
+                            problem = "sample";
+                            snprintf(detail, sizeof(detail), " (LED %i channel %i off by %i)", now.index[i], c, off);
+                        }
+                    }
+                }
+            }
+            if (problem != NULL)
+            {
+                if (failed < GOLDEN_MAX_REPORTED)
+                {
+                    printf("golden mismatch %s: %s%s\n", it->first.c_str(), problem, detail);
+                }
+                failed++;
+            }
+        }
+        // a case or frame that is no longer rendered fails too
+        int missing = 0;
+        for (std::map<std::string, GoldenFrame>::iterator it = expected.begin(); it != expected.end(); ++it)
+        {
+            if (computed.find(it->first) == computed.end())
+            {
+                if (failed + missing < GOLDEN_MAX_REPORTED)
+                {
+                    printf("golden mismatch %s: missing\n", it->first.c_str());
+                }
+                missing++;
+            }
+        }
+        printf("golden frames: %i identical, %i within tolerance %i, %i failed, %i missing\n", exact, (int)computed.size() - exact - failed, tolerance, failed, missing);
+        return failed + missing;
+    }
+
+    // the exit code of the golden run
+    int finish()
+    {
+        if (recording)
+        {
+            return write() ? 0 : 1;
+        }
+        return check() == 0 ? 0 : 1;
+    }
+};
+
+#endif
@@ -0,0 +1,251 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+// shade to wire latency. every frame carries a FrameStamp from the moment its time is
+// sampled until it is presented, --latency prints the per stage distribution on exit.
+// --latency-loopback measures what a real output adds on top: frames of the layout's
+// size are pushed through a localhost UDP socket and a pseudo terminal to a reader thread
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "clock.h"
+
+#define LATENCY_LOG_SIZE 4096
+// a loopback frame that has not arrived after this many seconds is lost
+#define LOOPBACK_TIMEOUT 1.
+// how often a waiting reader looks whether it was stopped, in milliseconds
+#define LOOPBACK_POLL_MS 50
+
+enum FrameStampPoint
+{
+    STAMP_SAMPLED,
+    STAMP_SHADED,
+    STAMP_COLORED,
+    STAMP_PRESENTED,
+    STAMP_COUNT
+};
+
+const char* latency_stage_names[STAMP_COUNT] = {"total", "shade", "color + preview", "present"};
+
+struct FrameStamp
+{
+    double at[STAMP_COUNT];
+    void mark(int point) {at[point] = SimClock::now();}
+    double total() {return at[STAMP_PRESENTED] - at[STAMP_SAMPLED];}
+};
+
+void print_percentiles(const char *name, std::vector<double> &values, double unit, const char *unit_name)
+{
+    if (values.empty())
+    {
+        return;
+    }
+    std::sort(values.begin(), values.end());
+    printf("    %-16s p50 %9.1f %s \t p99 %9.1f %s \t max %9.1f %s \t (%i samples)\n", name,
+           unit * values[values.size() / 2], unit_name, unit * values[(values.size() * 99) / 100], unit_name,
+           unit * values.back(), unit_name, (int)values.size());
+}
+
+// keeps the stage durations of the most recent frames, recording does not allocate
+struct LatencyLog
+{
+    bool enabled = false;
+    float stages[LATENCY_LOG_SIZE][STAMP_COUNT];
+    long count = 0;
+
+    void add(FrameStamp &stamp)
+    {
+        float *entry = stages[count % LATENCY_LOG_SIZE];
+        entry[0] = stamp.total();
+        for (int s = 1; s < STAMP_COUNT; s++)
+        {
+            entry[s] = stamp.at[s] - stamp.at[s - 1];
+        }
+        count++;
+    }
+
+    void report()
+    {
+        printf("frame latency over the last %li frames:\n", min(count, (long)LATENCY_LOG_SIZE));
+        std::vector<double> values;
+        for (int s = 0; s < STAMP_COUNT; s++)
+        {
+            values.clear();
+            for (long i = 0; i < min(count, (long)LATENCY_LOG_SIZE); i++)
+            {
+                values.push_back(stages[i][s]);
+            }
+            print_percentiles(latency_stage_names[s], values, 1e3, "ms");
+        }
+    }
+};
+
+// the arrival times are written by the reader thread while the sender polls them. a pty
+// cannot be shut down like a socket, so the reader also waits in poll() and gives up when
+// the sender sets stop
+struct LoopbackReader
+{
+    int fd;
+    int bytes;
+    int frames;
+    bool datagrams;
+    std::vector<std::atomic<double>> received;
+    std::atomic<bool> done;
+    std::atomic<bool> stop;
+
+    LoopbackReader(int fd, int bytes, int frames, bool datagrams) : fd(fd), bytes(bytes), frames(frames), datagrams(datagrams), received(frames), done(false), stop(false)
+    {
+        for (int f = 0; f < frames; f++)
+        {
+            received[f].store(0);
+        }
+    }
+
+    void run()
+    {
+        std::vector<char> buffer(bytes);
+        for (int f = 0; f < frames; f++)
+        {
+            int got = 0;
+            while (got < bytes)
+            {
+                struct pollfd ready = {fd, POLLIN, 0};
+                int waiting = poll(&ready, 1, LOOPBACK_POLL_MS);
+                if (stop.load() || waiting < 0)
+                {
+                    done.store(true);
+                    return;
+                }
+                if (waiting == 0)
+                {
+                    continue;
+                }
+                int n = datagrams ? recv(fd, &buffer[0], bytes, 0) : read(fd, &buffer[got], bytes - got);
+                if (n <= 0)
+                {
+                    done.store(true);
+                    return;
+                }
+                got += n;
+            }
+            received[f].store(SimClock::now());
+        }
+        done.store(true);
+    }
+};
+
+// sends the frames one by one, waiting for each to arrive, and returns the latencies
+bool measure_loopback(int write_fd, int read_fd, bool datagrams, int frames, int bytes, std::vector<double> &latencies)
+{
+    LoopbackReader reader(read_fd, bytes, frames, datagrams);
+    std::thread receiver(&LoopbackReader::run, &reader);
+    std::vector<char> frame(bytes, 0x55);
+    std::vector<double> sent(frames, 0);
+    bool ok = true;
+    for (int f = 0; f < frames && ok; f++)
+    {
+        memcpy(&frame[0], &f, min((int)sizeof(f), bytes));
+        sent[f] = SimClock::now();
+        ok = (datagrams ? send(write_fd, &frame[0], bytes, 0) : write(write_fd, &frame[0], bytes)) == bytes;
+        // a lost datagram or a reader that gave up fails the measurement instead of hanging it
+        while (ok && reader.received[f].load() == 0)
+        {
+            if (reader.done.load() || SimClock::now() - sent[f] > LOOPBACK_TIMEOUT)
+            {
+                ok = reader.received[f].load() != 0;
+                break;
+            }
+            std::this_thread::yield();
+        }
+    }
+    // the descriptors stay open, they are closed by whoever opened them
+    if (!ok)
+    {
+        reader.stop.store(true);
+        shutdown(read_fd, SHUT_RDWR);
+    }
+    receiver.join();
+    latencies.clear();
+    for (int f = 0; f < frames; f++)
+    {
+        if (reader.received[f].load() > 0)
+        {
+            latencies.push_back(reader.received[f].load() - sent[f]);
+        }
+    }
+    return ok;
+}
+
+int latency_loopback(int frames, int bytes)
+{
+    std::vector<double> latencies;
+    int failures = 0;
+    printf("loopback latency of %i frames with %i bytes each:\n", frames, bytes);
+
+    int rx = socket(AF_INET, SOCK_DGRAM, 0);
+    int tx = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in address;
+    socklen_t length = sizeof(address);
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    if (rx < 0 || tx < 0 || bytes > 65507
+        || bind(rx, (struct sockaddr*)&address, sizeof(address)) < 0
+        || getsockname(rx, (struct sockaddr*)&address, &length) < 0
+        || connect(tx, (struct sockaddr*)&address, sizeof(address)) < 0
+        || !measure_loopback(tx, rx, true, frames, bytes, latencies))
+    {
+        printf("    udp              failed\n");
+        failures++;
+    }
+    else
+    {
+        print_percentiles("udp", latencies, 1e6, "us");
+    }
+    close(rx);
+    close(tx);
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    int slave = -1;
+    if (master >= 0 && grantpt(master) == 0 && unlockpt(master) == 0)
+    {
+        slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    }
+    struct termios raw;
+    if (slave < 0 || tcgetattr(slave, &raw) < 0)
+    {
+        printf("    pty              failed\n");
+        failures++;
+    }
+    else
+    {
+        cfmakeraw(&raw);
+        tcsetattr(slave, TCSANOW, &raw);
+        if (measure_loopback(master, slave, false, frames, bytes, latencies))
+        {
+            print_percentiles("pty", latencies, 1e6, "us");
+        }
+        else
+        {
+            printf("    pty              failed\n");
+            failures++;
+        }
+    }
+    if (slave >= 0) close(slave);
+    if (master >= 0) close(master);
+    return failures;
+}
+
+#endif
@@ -0,0 +1,399 @@
+#ifndef LAYOUT_FILE_H
+#define LAYOUT_FILE_H
+
+// binary layout files, so that an installation can change without a rebuild. the file is
+// mmap'ed and read in place, there is nothing to parse:
+//
+//  LayoutHeader                    magic, version and where the tables are
+//  LayoutFigure[figures]           extent and the range of segments and LEDs of every figure
+//  LayoutSegment[segments]         origin, direction, LEDs and type, as the program's Segment
+//  LayoutPixel[pixels]             every LED's position and segment, in wiring order
+//
+// all values are little endian 32 bit. a newer version may append fields to the header
+// (header_size tells how long it is) or tables after the pixels, a reader only refuses
+// versions it does not know
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LAYOUT_MAGIC "SHADYLAY"
+#define LAYOUT_VERSION 1
+
+struct LayoutHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t figures;
+    uint32_t segments;
+    uint32_t pixels;
+    uint32_t figure_offset;     // in bytes from the start of the file
+    uint32_t segment_offset;
+    uint32_t pixel_offset;
+};
+
+struct LayoutFigure
+{
+    uint32_t first_segment;
+    uint32_t segments;
+    uint32_t first_pixel;
+    uint32_t pixels;
+    float width;
+    float height;
+};
+
+struct LayoutSegment
+{
+    float origin_x;
+    float origin_y;
+    float direction;            // 0 to 360 degrees
+    int32_t pixels;
+    int32_t type;
+};
+
+struct LayoutPixel
+{
+    float x;
+    float y;
+    int32_t segment;            // within its figure
+};
+
+// the extent of a figure, uv are x / width and y / height
+struct LayoutExtent
+{
+    float width;
+    float height;
+};
+
+struct LayoutFile
+{
+    void *data = MAP_FAILED;
+    size_t size = 0;
+    const LayoutHeader *header = NULL;
+
+    ~LayoutFile() {close();}
+
+    bool open(const char *path)
+    {
+        close();
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+        {
+            printf("could not open layout %s\n", path);
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < sizeof(LayoutHeader))
+        {
+            printf("layout %s: not a layout file\n", path);
+            ::close(fd);
+            return false;
+        }
+        size = st.st_size;
+        data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+        {
+            printf("could not map layout %s\n", path);
+            return false;
+        }
+        header = (const LayoutHeader*)data;
+        const char *problem = check();
+        if (problem != NULL)
+        {
+            printf("layout %s: %s\n", path, problem);
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (data != MAP_FAILED)
+        {
+            munmap(data, size);
+        }
+        data = MAP_FAILED;
+        size = 0;
+        header = NULL;
+    }
+
+    // NULL when the tables are where the header says, so that the accessors need no checks
+    const char* check()
+    {
+        if (memcmp(header->magic, LAYOUT_MAGIC, sizeof(header->magic)) != 0)
+        {
+            return "not a layout file";
+        }
+        if (header->version != LAYOUT_VERSION)
+        {
+            return "unknown version";
+        }
+        if (header->header_size < sizeof(LayoutHeader) || header->header_size > size)
+        {
+            return "header size out of range";
+        }
+        if (!fits(header->figure_offset, header->figures, sizeof(LayoutFigure)) ||
+            !fits(header->segment_offset, header->segments, sizeof(LayoutSegment)) ||
+            !fits(header->pixel_offset, header->pixels, sizeof(LayoutPixel)))
+        {
+            return "truncated";
+        }
+        for (int f = 0; f < header->figures; f++)
+        {
+            const LayoutFigure &figure = get_figure(f);
+            if ((uint64_t)figure.first_segment + figure.segments > header->segments ||
+                (uint64_t)figure.first_pixel + figure.pixels > header->pixels)
+            {
+                return "figure out of range";
+            }
+            if (!(figure.width > 0) || !(figure.height > 0))
+            {
+                return "figure without extent";
+            }
+            // the segments' LEDs have to be the figure's LEDs, they size P and drive the shading
+            const LayoutSegment *segments = get_segments(f);
+            uint64_t count = 0;
+            for (int s = 0; s < figure.segments; s++)
+            {
+                if (segments[s].pixels < 0)
+                {
+                    return "segment with a negative number of LEDs";
+                }
+                count += segments[s].pixels;
+            }
+            if (count != figure.pixels)
+            {
+                return "segments do not add up to the figure's LEDs";
+            }
+            const LayoutPixel *pixels = get_pixels(f);
+            for (int p = 0; p < figure.pixels; p++)
+            {
+                if (pixels[p].segment < 0 || pixels[p].segment >= figure.segments)
+                {
+                    return "LED on a segment out of range";
+                }
+            }
+        }
+        return NULL;
+    }
+
+    // a table after the header and within the file
+    bool fits(uint32_t offset, uint32_t count, size_t record)
+    {
+        return offset % 4 == 0 && offset >= header->header_size && offset + (uint64_t)count * record <= size;
+    }
+
+    int figures() {return header->figures;}
+    LayoutExtent get_extent(int f) {LayoutExtent extent = {get_figure(f).width, get_figure(f).height}; return extent;}
+    const LayoutFigure& get_figure(int f) {return ((const LayoutFigure*)((const char*)data + header->figure_offset))[f];}
+    const LayoutSegment* get_segments(int f) {return (const LayoutSegment*)((const char*)data + header->segment_offset) + get_figure(f).first_segment;}
+    const LayoutPixel* get_pixels(int f) {return (const LayoutPixel*)((const char*)data + header->pixel_offset) + get_figure(f).first_pixel;}
+
+    // S needs set_origin, set_direction, pixels and type like the Segment of shadymatrix_satoritree
+    template<typename S> void read_segments(int f, std::vector<S> &segments)
+    {
+        const LayoutSegment *stored = get_segments(f);
+        segments.clear();
+        for (int s = 0; s < get_figure(f).segments; s++)
+        {
+            S segment(0, 0, 1, 0);
+            segment.set_origin(stored[s].origin_x, stored[s].origin_y);
+            segment.set_direction(stored[s].direction);
+            segment.pixels = stored[s].pixels;
+            segment.type = stored[s].type;
+            segments.push_back(segment);
+        }
+    }
+
+    // the LEDs straight from the precomputed table
+    template<typename T> void read_pixels(int f, std::vector<T> &P)
+    {
+        const LayoutPixel *stored = get_pixels(f);
+        P.resize(get_figure(f).pixels);
+        for (int p = 0; p < P.size(); p++)
+        {
+            P[p].x = stored[p].x;
+            P[p].y = stored[p].y;
+            P[p].segcount = stored[p].segment;
+        }
+    }
+};
+
+// from the origin to beyond the LEDs by as much as they are away from the origin, so that a
+// figure keeps its margin on both sides
+template<typename S> LayoutExtent layout_extent(std::vector<S> &segments)
+{
+    float min_x = 1e30, min_y = 1e30, max_x = 0, max_y = 0;
+    for (int s = 0; s < segments.size(); s++)
+    {
+        for (int p = 0; p < segments[s].pixels; p++)
+        {
+            vec2 v = segments[s].get_pixel(p);
+            min_x = min(min_x, v.x);
+            min_y = min(min_y, v.y);
+            max_x = max(max_x, v.x);
+            max_y = max(max_y, v.y);
+        }
+    }
+    LayoutExtent extent = {max(max_x + max(min_x, 0.f), 1.f), max(max_y + max(min_y, 0.f), 1.f)};
+    return extent;
+}
+
+// one extent per figure, the LED positions are computed with the segments' get_pixel
+template<typename S> bool write_layout(const char *path, std::vector<std::vector<S>> &figures, std::vector<LayoutExtent> &extents)
+{
+    std::vector<LayoutFigure> figure_table;
+    std::vector<LayoutSegment> segment_table;
+    std::vector<LayoutPixel> pixel_table;
+    for (int f = 0; f < figures.size(); f++)
+    {
+        LayoutFigure figure = {(uint32_t)segment_table.size(), (uint32_t)figures[f].size(), (uint32_t)pixel_table.size(), 0, extents[f].width, extents[f].height};
+        for (int s = 0; s < figures[f].size(); s++)
+        {
+            S &segment = figures[f][s];
+            LayoutSegment stored = {segment.origin_x, segment.origin_y, segment.direction, segment.pixels, segment.type};
+            segment_table.push_back(stored);
+            for (int p = 0; p < segment.pixels; p++)
+            {
+                vec2 v = segment.get_pixel(p);
+                LayoutPixel pixel = {v.x, v.y, s};
+                pixel_table.push_back(pixel);
+            }
+        }
+        figure.pixels = pixel_table.size() - figure.first_pixel;
+        figure_table.push_back(figure);
+    }
+
+    LayoutHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LAYOUT_MAGIC, sizeof(header.magic));
+    header.version = LAYOUT_VERSION;
+    header.header_size = sizeof(header);
+    header.figures = figure_table.size();
+    header.segments = segment_table.size();
+    header.pixels = pixel_table.size();
+    header.figure_offset = sizeof(header);
+    header.segment_offset = header.figure_offset + figure_table.size() * sizeof(LayoutFigure);
+    header.pixel_offset = header.segment_offset + segment_table.size() * sizeof(LayoutSegment);
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        printf("could not write %s\n", path);
+        return false;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(figure_table.data(), sizeof(LayoutFigure), figure_table.size(), file) == figure_table.size() &&
+                   fwrite(segment_table.data(), sizeof(LayoutSegment), segment_table.size(), file) == segment_table.size() &&
+                   fwrite(pixel_table.data(), sizeof(LayoutPixel), pixel_table.size(), file) == pixel_table.size();
+    written = fclose(file) == 0 && written;
+    if (!written)
+    {
+        printf("could not write %s\n", path);
+        return false;
+    }
+    printf("wrote %i figures, %i segments and %i LEDs to %s\n", header.figures, header.segments, header.pixels, path);
+    return true;
+}
+
+// true when at is within a string literal that starts on the line text
+inline bool in_string_literal(const char *text, const char *at)
+{
+    bool inside = false;
+    for (const char *c = text; c < at; c++)
+    {
+        if (inside && *c == '\\')
+        {
+            c++;
+        }
+        else if (*c == '"')
+        {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+// imports segments.push_back(Segment(x, y, to_x, to_y[, type])) listings like dergutewal.c or
+// what the editor used to print, and {x, y, to_x, to_y[, type]} lines of BakedSegment arrays
+// like the figures of shadymatrix_satoritree. a figure ends at segments.clear(),
+// figures.push_back(segments), the start or end of an array or a comment heading
+// ("// DER GUTE WAL"). segments whose coordinates are not plain numbers (loops, constants)
+// are skipped and counted. the coordinates are taken as they are plus offset, not with the
+// origin offset the constructor of the importing program's S may add
+template<typename S> int import_listing(const char *path, std::vector<std::vector<S>> &figures, float offset_x = 0, float offset_y = 0)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        printf("could not read %s\n", path);
+        return -1;
+    }
+    char line[1024];
+    int skipped = 0;
+    std::vector<S> segments;
+    while (fgets(line, sizeof(line), file))
+    {
+        const char *text = line + strspn(line, " \t");
+        const char *call = strstr(text, "Segment(");
+        // the push_back a program prints, like the editor does, is no segment
+        if (call != NULL && in_string_literal(text, call))
+        {
+            call = NULL;
+        }
+        bool heading = text[0] == '/' && text[1] == '/' && strpbrk(text, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz") != NULL;
+        if (strstr(text, "segments.clear()") != NULL || strstr(text, "figures.push_back") != NULL || strstr(text, "[] =") != NULL ||
+            !strncmp(text, "};", 2) || (heading && call == NULL))
+        {
+            if (!segments.empty())
+            {
+                figures.push_back(segments);
+                segments.clear();
+            }
+            continue;
+        }
+        const char *values = NULL;
+        char close = ')';
+        if (call != NULL && strstr(text, "push_back") != NULL && text[0] != '/')
+        {
+            values = call + strlen("Segment(");
+        }
+        else if (text[0] == '{' && strchr("-.0123456789", text[1 + strspn(text + 1, " ")]) != NULL)
+        {
+            values = text + 1;
+            close = '}';
+        }
+        if (values == NULL)
+        {
+            continue;
+        }
+        float x, y, to_x, to_y;
+        int type = 0, used = 0;
+        int found = sscanf(values, "%f , %f , %f , %f%n , %i", &x, &y, &to_x, &to_y, &used, &type);
+        if (found < 4 || (values[used + strspn(values + used, " ")] != close && found < 5))
+        {
+            skipped++;
+            continue;
+        }
+        S segment(x, y, to_x, to_y);
+        segment.set_origin(x + offset_x, y + offset_y);
+        segment.type = found < 5 ? 0 : type;
+        segments.push_back(segment);
+    }
+    fclose(file);
+    if (!segments.empty())
+    {
+        figures.push_back(segments);
+    }
+    return skipped;
+}
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+// Prometheus text exposition on http://127.0.0.1:<port>/metrics (--metrics [port]) for
+// unattended installations. the frame loop only does relaxed atomic stores and adds,
+// formatting and socket handling happen on the exporter thread
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define METRICS_DEFAULT_PORT 9110
+#define METRICS_BUCKETS 9
+// a client that does not send its request within this many seconds is dropped
+#define METRICS_CLIENT_TIMEOUT 1
+// frames between two estimates of the current, each walks over all LEDs
+#define METRICS_CURRENT_EVERY 30
+
+// upper bounds of the frame time histogram in seconds, the last one is +Inf
+const double metrics_frame_buckets[METRICS_BUCKETS] = {.001, .002, .004, .008, .0167, .0333, .05, .1, 0};
+
+struct AtomicDouble
+{
+    std::atomic<double> value;
+    AtomicDouble() : value(0) {}
+    void set(double v) {value.store(v, std::memory_order_relaxed);}
+    double get() {return value.load(std::memory_order_relaxed);}
+};
+
+struct FrameHistogram
+{
+    std::atomic<long> buckets[METRICS_BUCKETS];
+    std::atomic<long> count;
+    std::atomic<long long> sum_ns;
+
+    FrameHistogram() : count(0), sum_ns(0)
+    {
+        for (int b = 0; b < METRICS_BUCKETS; b++)
+        {
+            buckets[b].store(0);
+        }
+    }
+
+    void observe(double seconds)
+    {
+        int b = 0;
+        while (b < METRICS_BUCKETS - 1 && seconds > metrics_frame_buckets[b])
+        {
+            b++;
+        }
+        buckets[b].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sum_ns.fetch_add((long long)(1e9 * seconds), std::memory_order_relaxed);
+    }
+};
+
+void render_histogram(std::string &out, const char *name, const char *help, FrameHistogram &histogram)
+{
+    char line[256];
+    snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    out += line;
+    long cumulative = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++)
+    {
+        cumulative += histogram.buckets[b].load(std::memory_order_relaxed);
+        if (b < METRICS_BUCKETS - 1)
+        {
+            snprintf(line, sizeof(line), "%s_bucket{le=\"%g\"} %ld\n", name, metrics_frame_buckets[b], cumulative);
+        }
+        else
+        {
+            snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %ld\n", name, cumulative);
+        }
+        out += line;
+    }
+    snprintf(line, sizeof(line), "%s_sum %.6f\n%s_count %ld\n", name, 1e-9 * histogram.sum_ns.load(std::memory_order_relaxed),
+             name, histogram.count.load(std::memory_order_relaxed));
+    out += line;
+}
+
+struct MetricsExporter
+{
+    FrameHistogram frame_time;
+    FrameHistogram latency;
+    std::atomic<long> frames_dropped;
+    std::atomic<int> queue_depth;
+    AtomicDouble shade_ns_per_pixel;
+    AtomicDouble current_amps;
+    AtomicDouble uptime;
+    AtomicDouble time_drift;
+    std::atomic<int> pixels;
+    long frames = 0;        // counted by the frame loop only
+
+    std::atomic<bool> running;
+    int listen_fd = -1;
+    std::thread server;
+
+    MetricsExporter() : frames_dropped(0), queue_depth(0), pixels(0), running(false) {}
+    ~MetricsExporter() {stop();}
+
+    bool start(int port)
+    {
+        listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (listen_fd < 0)
+        {
+            printf("metrics: could not create socket.\n");
+            return false;
+        }
+        int yes = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listen_fd, 4) < 0)
+        {
+            printf("metrics: could not listen on 127.0.0.1:%i.\n", port);
+            close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+        running = true;
+        server = std::thread(&MetricsExporter::serve, this);
+        printf("metrics on http://127.0.0.1:%i/metrics\n", port);
+        return true;
+    }
+
+    void stop()
+    {
+        if (!running)
+        {
+            return;
+        }
+        running = false;
+        server.join();
+        close(listen_fd);
+        listen_fd = -1;
+    }
+
+    std::string render()
+    {
+        std::string out;
+        char line[256];
+
+        render_histogram(out, "shadymatrix_frame_seconds", "Wall time per rendered frame.", frame_time);
+        render_histogram(out, "shadymatrix_latency_seconds", "From sampling the frame time to presenting the frame.", latency);
+
+        snprintf(line, sizeof(line), "# HELP shadymatrix_frames_dropped_total Frames that missed their slot and skipped pattern steps.\n# TYPE shadymatrix_frames_dropped_total counter\nshadymatrix_frames_dropped_total %ld\n",
+                 frames_dropped.load(std::memory_order_relaxed));
+        out += line;
+        snprintf(line, sizeof(line), "# HELP shadymatrix_queue_depth Editor commands decoded from the input of the last frame.\n# TYPE shadymatrix_queue_depth gauge\nshadymatrix_queue_depth %i\n",
+                 queue_depth.load(std::memory_order_relaxed));
+        out += line;
+        snprintf(line, sizeof(line), "# HELP shadymatrix_pixels Number of LEDs in the layout.\n# TYPE shadymatrix_pixels gauge\nshadymatrix_pixels %i\n",
+                 pixels.load(std::memory_order_relaxed));
+        out += line;
+        snprintf(line, sizeof(line), "# HELP shadymatrix_shade_ns_per_pixel Shading time of the last frame per LED.\n# TYPE shadymatrix_shade_ns_per_pixel gauge\nshadymatrix_shade_ns_per_pixel %.2f\n",
+                 shade_ns_per_pixel.get());
+        out += line;
+        snprintf(line, sizeof(line), "# HELP shadymatrix_current_amperes Estimated strip current, sampled every few frames.\n# TYPE shadymatrix_current_amperes gauge\nshadymatrix_current_amperes %.3f\n",
+                 current_amps.get());
+        out += line;
+        snprintf(line, sizeof(line), "# HELP shadymatrix_uptime_seconds Wall time since the show started.\n# TYPE shadymatrix_uptime_seconds gauge\nshadymatrix_uptime_seconds %.1f\n",
+                 uptime.get());
+        out += line;
+        snprintf(line, sizeof(line), "# HELP shadymatrix_time_drift_seconds How far the pattern clock lags behind wall time.\n# TYPE shadymatrix_time_drift_seconds gauge\nshadymatrix_time_drift_seconds %.4f\n",
+                 time_drift.get());
+        out += line;
+        return out;
+    }
+
+    void serve()
+    {
+        struct pollfd waiting;
+        waiting.fd = listen_fd;
+        waiting.events = POLLIN;
+        while (running)
+        {
+            if (poll(&waiting, 1, 200) <= 0)
+            {
+                continue;
+            }
+            int client = accept(listen_fd, NULL, NULL);
+            if (client < 0)
+            {
+                continue;
+            }
+            // one silent client must not hold up every scrape after it
+            struct timeval timeout = {METRICS_CLIENT_TIMEOUT, 0};
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            char request[1024];
+            if (recv(client, request, sizeof(request), 0) <= 0)
+            {
+                close(client);
+                continue;
+            }
+            std::string body = render();
+            char header[128];
+            snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %i\r\n\r\n", (int)body.size());
+            send(client, header, strlen(header), MSG_NOSIGNAL);
+            send(client, body.c_str(), body.size(), MSG_NOSIGNAL);
+            close(client);
+        }
+    }
+};
+
+// WS2812: about 20 mA per color channel at full brightness
+float estimate_current(std::vector<Pixel> &P)
+{
+    long sum = 0;
+    for (std::vector<Pixel>::iterator p = P.begin(); p != P.end(); ++p)
+    {
+        sum += p->L.getR() + p->L.getG() + p->L.getB();
+    }
+    return 0.02 * sum / 255.;
+}
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+// hardware counters around the shading stage (--perf), to tell whether a pattern is
+// compute or memory bound. linux only, every counter that cannot be opened (no PMU in
+// a VM, perf_event_paranoid, ...) is just reported as unavailable
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define PERF_MAX_PATTERNS 16
+
+enum PerfCounter
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTER_COUNT
+};
+
+const char* perf_counter_names[PERF_COUNTER_COUNT] = {"cycles", "instructions", "cache misses", "branch misses"};
+
+struct PerfCounters
+{
+    int fd[PERF_COUNTER_COUNT];
+    bool enabled = false;
+    long long started[PERF_COUNTER_COUNT];
+    long long totals[PERF_MAX_PATTERNS][PERF_COUNTER_COUNT];
+    long long pixels[PERF_MAX_PATTERNS];
+    long frames[PERF_MAX_PATTERNS];
+
+    PerfCounters()
+    {
+        for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+        {
+            fd[c] = -1;
+        }
+        memset(totals, 0, sizeof(totals));
+        memset(pixels, 0, sizeof(pixels));
+        memset(frames, 0, sizeof(frames));
+    }
+
+#ifdef __linux__
+    static int open_counter(unsigned long long config, int group)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.disabled = group < 0 ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+    }
+
+    bool open()
+    {
+        unsigned long long configs[PERF_COUNTER_COUNT] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        fd[0] = open_counter(configs[0], -1);
+        if (fd[0] < 0)
+        {
+            printf("perf: hardware counters unavailable (%s), --perf ignored.\n", strerror(errno));
+            return false;
+        }
+        for (int c = 1; c < PERF_COUNTER_COUNT; c++)
+        {
+            fd[c] = open_counter(configs[c], fd[0]);
+            if (fd[c] < 0)
+            {
+                printf("perf: %s unavailable.\n", perf_counter_names[c]);
+            }
+        }
+        ioctl(fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        enabled = true;
+        return true;
+    }
+
+    void close_all()
+    {
+        for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+        {
+            if (fd[c] >= 0)
+            {
+                close(fd[c]);
+                fd[c] = -1;
+            }
+        }
+        enabled = false;
+    }
+
+    void sample(long long *values)
+    {
+        for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+        {
+            values[c] = 0;
+            if (fd[c] >= 0 && read(fd[c], &values[c], sizeof(long long)) != sizeof(long long))
+            {
+                values[c] = 0;
+            }
+        }
+    }
+#else
+    bool open()
+    {
+        printf("perf: hardware counters are only supported on linux, --perf ignored.\n");
+        return false;
+    }
+    void close_all() {}
+    void sample(long long *values) {}
+#endif
+
+    void begin()
+    {
+        sample(started);
+    }
+
+    void end(int pattern, int pixel_count)
+    {
+        long long now[PERF_COUNTER_COUNT];
+        sample(now);
+        pattern = pattern % PERF_MAX_PATTERNS;
+        for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+        {
+            totals[pattern][c] += now[c] - started[c];
+        }
+        pixels[pattern] += pixel_count;
+        frames[pattern]++;
+    }
+
+    void report()
+    {
+        for (int p = 0; p < PERF_MAX_PATTERNS; p++)
+        {
+            if (frames[p] == 0)
+            {
+                continue;
+            }
+            printf("pattern %i: %ld frames, %lld pixels shaded\n", p, frames[p], pixels[p]);
+            for (int c = 0; c < PERF_COUNTER_COUNT; c++)
+            {
+                if (fd[c] < 0)
+                {
+                    printf("    %-14s unavailable\n", perf_counter_names[c]);
+                    continue;
+                }
+                printf("    %-14s %14lld \t %10.2f / frame \t %8.3f / pixel\n", perf_counter_names[c], totals[p][c],
+                       (double)totals[p][c] / frames[p], pixels[p] > 0 ? (double)totals[p][c] / pixels[p] : 0.);
+            }
+            if (fd[PERF_CYCLES] >= 0 && fd[PERF_INSTRUCTIONS] >= 0 && totals[p][PERF_CYCLES] > 0)
+            {
+                printf("    IPC %.2f\n", (double)totals[p][PERF_INSTRUCTIONS] / totals[p][PERF_CYCLES]);
+            }
+        }
+    }
+};
+
+#endif
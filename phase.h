@@ -0,0 +1,138 @@
+#ifndef PHASE_H
+#define PHASE_H
+
+#include <vector>
+#include <cmath>
+#include <stdio.h>
+
+// a float time loses sub-step resolution after 2^24 steps (about 3 days at 60 Hz),
+// so patterns register their periodic phases here instead. they are accumulated and
+// wrapped in double precision and handed to the shaders as small floats
+struct Phase
+{
+    double period;
+    double rate;     // phase units per simulation step
+    double value;    // in [0, period) at the last whole step
+    long cycles;     // whole periods passed, for patterns that reseed every period
+    float shown;     // value at the interpolated time of the current frame
+};
+
+struct PhaseBank
+{
+    std::vector<Phase> phases;
+
+    // period 2 PI gives an angle for sin/cos, rate is the old factor in front of time and
+    // start the old offset added to it
+    int add(double period, double rate, double start = 0)
+    {
+        Phase phase;
+        phase.period = period;
+        phase.rate = rate;
+        phase.value = wrap(start, period);
+        phase.cycles = 0;
+        phase.shown = phase.value;
+        phases.push_back(phase);
+        return phases.size() - 1;
+    }
+
+    void clear()
+    {
+        phases.clear();
+    }
+
+    static double wrap(double v, double period)
+    {
+        if (v >= 0 && v < period)
+        {
+            return v;
+        }
+        if (v >= period && v < 2 * period)
+        {
+            return v - period;
+        }
+        v = fmod(v, period);
+        return v < 0 ? v + period : v;
+    }
+
+    void advance(double steps)
+    {
+        for (std::vector<Phase>::iterator ph = phases.begin(); ph != phases.end(); ++ph)
+        {
+            double next = ph->value + ph->rate * steps;
+            ph->value = wrap(next, ph->period);
+            if (next >= ph->period || next < 0)
+            {
+                ph->cycles += (long)floor(next / ph->period);
+            }
+        }
+    }
+
+    // alpha 0 is the step before the last one and 1 the last one, like the positions a
+    // pattern interpolates between its previous and its current step
+    void interpolate(float alpha)
+    {
+        for (std::vector<Phase>::iterator ph = phases.begin(); ph != phases.end(); ++ph)
+        {
+            ph->shown = wrap(ph->value + ph->rate * (alpha - 1), ph->period);
+        }
+    }
+
+    float get(int id) {return phases[id].shown;}
+    double last(int id) {return phases[id].value;}
+    long cycles(int id) {return phases[id].cycles;}
+};
+
+// steps every phase through the given number of days one simulation step at a time and
+// checks that each step still moves the float phase by its rate, and that the accumulated
+// value has not drifted from the exact one. returns 0 when smooth
+int soak_phases(PhaseBank &bank, double days, double steps_per_second)
+{
+    long steps = (long)(days * 86400. * steps_per_second);
+    const double step_tolerance = 1e-4;
+    const double drift_tolerance = 1e-6;
+    int failures = 0;
+
+    for (std::vector<Phase>::iterator ph = bank.phases.begin(); ph != bank.phases.end(); ++ph)
+    {
+        ph->value = 0;
+    }
+    std::vector<float> last(bank.phases.size(), 0);
+    std::vector<double> worst_step(bank.phases.size(), 0);
+
+    for (long s = 1; s <= steps; s++)
+    {
+        bank.advance(1);
+        for (int i = 0; i < bank.phases.size(); i++)
+        {
+            Phase &ph = bank.phases[i];
+            float now = (float)ph.value;
+            double delta = PhaseBank::wrap((double)now - last[i], ph.period);
+            double error = fabs(delta - PhaseBank::wrap(ph.rate, ph.period));
+            error = fmin(error, ph.period - error);
+            if (error > worst_step[i])
+            {
+                worst_step[i] = error;
+            }
+            last[i] = now;
+        }
+    }
+
+    for (int i = 0; i < bank.phases.size(); i++)
+    {
+        Phase &ph = bank.phases[i];
+        long double exact = fmodl((long double)ph.rate * steps, (long double)ph.period);
+        double drift = fabs((double)(exact - ph.value));
+        drift = fmin(drift, ph.period - drift);
+        bool ok = worst_step[i] < step_tolerance && drift < drift_tolerance;
+        printf("phase %i \t period %g \t rate %g \t worst step error %.3g \t drift %.3g \t %s\n",
+               i, ph.period, ph.rate, worst_step[i], drift, ok ? "ok" : "FAILED");
+        if (!ok)
+        {
+            failures++;
+        }
+    }
+    printf("%ld steps (%g days at %g Hz), %i phases failed\n", steps, days, steps_per_second, failures);
+    return failures;
+}
+
+#endif
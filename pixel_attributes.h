@@ -0,0 +1,132 @@
+#ifndef PIXEL_ATTRIBUTES_H
+#define PIXEL_ATTRIBUTES_H
+
+// per LED values derived from the layout alone, computed once per layout instead of by the
+// shaders in every frame. each attribute is a plane indexed like P, and only the planes some
+// pattern asked for are computed:
+//
+//  ATTR_UV         u, v        x / width and y / height, the coord the shaders get
+//  ATTR_POLAR      r, phi      around center in uv, phi in degrees (-180 to 180)
+//  ATTR_ARC        arc         distance along the wiring from the first LED, in cm, the
+//                              wire between the end of a segment and the next one included
+//  ATTR_SEGMENT    index       the LED's number within its segment
+//                  direction   of its segment in degrees, like Segment::direction
+//                  segment     the segment's number and type
+//                  type
+//
+// the layout does not say when it changed, whoever edits or replaces it calls invalidate()
+
+#include <vector>
+#include <cmath>
+
+enum PixelAttribute
+{
+    ATTR_UV = 1,
+    ATTR_POLAR = 2,
+    ATTR_ARC = 4,
+    ATTR_SEGMENT = 8
+};
+
+struct PixelAttributes
+{
+    unsigned planes = 0;    // the ones that are up to date
+    vec2 center;
+    double degrees;         // per radian, with the PI of the program
+    std::vector<float> u, v;
+    std::vector<float> r, phi;
+    std::vector<float> arc;
+    std::vector<int> index;
+    std::vector<float> direction;
+    std::vector<int> segment;
+    std::vector<int> type;
+
+    PixelAttributes(vec2 center, double pi) : center(center), degrees(180. / pi) {}
+
+    void invalidate() {planes = 0;}
+
+    void set_center(vec2 c)
+    {
+        center = c;
+        planes &= ~ATTR_POLAR;
+    }
+
+    // computes the wanted planes that are missing. the pixels are in the order of shade_frame
+    template<typename S> void update(std::vector<S> &segments, unsigned wanted, float width, float height)
+    {
+        if ((wanted & ~planes) == 0)
+        {
+            return;
+        }
+        wanted |= planes;
+        int count = 0;
+        for (int s = 0; s < segments.size(); s++)
+        {
+            count += segments[s].pixels;
+        }
+        resize(wanted, count);
+        int i = 0;
+        float along = 0;
+        vec2 last;
+        for (int s = 0; s < segments.size(); s++)
+        {
+            for (int p = 0; p < segments[s].pixels; p++, i++)
+            {
+                vec2 coord = segments[s].get_pixel(p);
+                vec2 relative_coord = vec2(coord.x/width, coord.y/height);
+                if (wanted & ATTR_UV)
+                {
+                    u[i] = relative_coord.x;
+                    v[i] = relative_coord.y;
+                }
+                if (wanted & ATTR_POLAR)
+                {
+                    double dx = (double)relative_coord.x - center.x;
+                    double dy = (double)relative_coord.y - center.y;
+                    r[i] = sqrt(pow(dx, 2) + pow(dy, 2));
+                    phi[i] = degrees * atan2(dy, dx);
+                }
+                if (wanted & ATTR_ARC)
+                {
+                    along += i > 0 ? last.get_distance_to(coord) : 0;
+                    arc[i] = along;
+                    last = coord;
+                }
+                if (wanted & ATTR_SEGMENT)
+                {
+                    index[i] = p;
+                    direction[i] = segments[s].direction;
+                    segment[i] = s;
+                    type[i] = segments[s].type;
+                }
+            }
+        }
+        planes = wanted;
+    }
+
+    void resize(unsigned wanted, int count)
+    {
+        if (wanted & ATTR_UV)
+        {
+            u.resize(count);
+            v.resize(count);
+        }
+        if (wanted & ATTR_POLAR)
+        {
+            r.resize(count);
+            phi.resize(count);
+        }
+        if (wanted & ATTR_ARC)
+        {
+            arc.resize(count);
+        }
+        if (wanted & ATTR_SEGMENT)
+        {
+            index.resize(count);
+            direction.resize(count);
+            segment.resize(count);
+            type.resize(count);
+        }
+    }
+};
+
+#endif
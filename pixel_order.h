@@ -0,0 +1,134 @@
+#ifndef PIXEL_ORDER_H
+#define PIXEL_ORDER_H
+
+// shading in an order along a space filling curve instead of along the wiring. on soups of
+// short segments or serpentine grids, LEDs that are next to each other in P can be far apart
+// in space; sorted along a Morton (Z) or Hilbert curve, neighbours in memory are neighbours
+// on the layout. the LEDs are shaded into a buffer in curve order, remap() puts the colors
+// back in wiring order for the preview and the outputs. culled, incremental and separable
+// shading walk the LEDs in the same order, and the region grid keeps it within its cells.
+//
+// like the attribute planes the order is built once per layout, invalidate() when it changed
+
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+enum PixelCurve
+{
+    ORDER_WIRING,
+    ORDER_MORTON,
+    ORDER_HILBERT,
+    ORDER_CURVE_COUNT
+};
+
+const char* pixel_curve_names[ORDER_CURVE_COUNT] = {"wiring", "morton", "hilbert"};
+
+int pixel_curve(const char *name)
+{
+    for (int c = 0; c < ORDER_CURVE_COUNT; c++)
+    {
+        if (!strcmp(name, pixel_curve_names[c]))
+        {
+            return c;
+        }
+    }
+    return -1;
+}
+
+// 16 bits of x and y interleaved
+inline unsigned morton_key(unsigned x, unsigned y)
+{
+    unsigned key = 0;
+    for (int b = 0; b < 16; b++)
+    {
+        key |= ((x >> b) & 1) << (2 * b) | ((y >> b) & 1) << (2 * b + 1);
+    }
+    return key;
+}
+
+// distance along the Hilbert curve through a 65536 x 65536 grid
+inline unsigned hilbert_key(unsigned x, unsigned y)
+{
+    unsigned key = 0;
+    for (unsigned s = 1u << 15; s > 0; s >>= 1)
+    {
+        unsigned rx = (x & s) != 0;
+        unsigned ry = (y & s) != 0;
+        key += s * s * ((3 * rx) ^ ry);
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = 0xffff - x;
+                y = 0xffff - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return key;
+}
+
+// what the shader needs of one LED, and where it is on the wiring
+struct OrderedPixel
+{
+    float u;
+    float v;
+    int segment;
+    int type;
+    int wiring;
+};
+
+struct PixelOrder
+{
+    int curve = ORDER_WIRING;
+    bool built = false;
+    std::vector<OrderedPixel> pixels;   // in curve order
+    std::vector<LED> shaded;            // the colors, in curve order too
+    std::vector<int> rank;              // per LED on the wiring, its place on the curve
+
+    void invalidate() {built = false;}
+
+    // sorts the LEDs of the segments along the curve and puts their positions into P
+    template<typename S> void build(std::vector<S> &segments, std::vector<Pixel> &P, float width, float height)
+    {
+        std::vector<std::pair<unsigned, int>> keys;
+        pixels.clear();
+        P.clear();
+        for (int s = 0; s < segments.size(); s++)
+        {
+            for (int p = 0; p < segments[s].pixels; p++)
+            {
+                vec2 coord = segments[s].get_pixel(p);
+                OrderedPixel pixel = {coord.x/width, coord.y/height, s, segments[s].type, (int)P.size()};
+                unsigned qx = constrain(pixel.u, 0.f, 1.f) * 0xffff;
+                unsigned qy = constrain(pixel.v, 0.f, 1.f) * 0xffff;
+                keys.push_back(std::make_pair(curve == ORDER_HILBERT ? hilbert_key(qx, qy) : curve == ORDER_MORTON ? morton_key(qx, qy) : 0, pixel.wiring));
+                pixels.push_back(pixel);
+                P.push_back(Pixel(coord, s));
+            }
+        }
+        std::sort(keys.begin(), keys.end());
+        std::vector<OrderedPixel> sorted(pixels.size());
+        rank.resize(pixels.size());
+        for (int k = 0; k < keys.size(); k++)
+        {
+            sorted[k] = pixels[keys[k].second];
+            rank[keys[k].second] = k;
+        }
+        pixels.swap(sorted);
+        shaded.resize(pixels.size());
+        built = true;
+    }
+
+    // the colors back to the LEDs they are wired to
+    void remap(std::vector<Pixel> &P)
+    {
+        for (int k = 0; k < pixels.size(); k++)
+        {
+            P[pixels[k].wiring].L = shaded[k];
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <vector>
+#include "shade_cache.h"
+
+// LEDs whose color moved by less than this (per channel, 0..255) are not redrawn
+#define PREVIEW_COLOR_THRESHOLD 3
+// above this fraction of changed LEDs a full redraw is cheaper than region updates
+#define PREVIEW_FULL_REDRAW_FRACTION .25
+// half width of the strip rectangle lines, in screen pixels
+#define OUTLINE_THICKNESS 1.
+
+// keeps the preview in render target textures between frames:
+// background (margin, outline, helper lines) and overlay (strip rectangles) only change
+// with the layout, the view or the editor, the lights layer is patched where LEDs changed
+struct PreviewCache
+{
+    SDL_Texture *background = NULL;
+    SDL_Texture *lights = NULL;
+    SDL_Texture *overlay = NULL;
+    int w = 0;
+    int h = 0;
+    bool dirty = true;
+    std::vector<Uint32> drawn;
+    std::vector<int> changed;
+
+    bool create(SDL_Renderer *renderer, int width, int height)
+    {
+        w = width;
+        h = height;
+        background = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h);
+        lights = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h);
+        overlay = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, w, h);
+        if (background == NULL || lights == NULL || overlay == NULL)
+        {
+            destroy();
+            return false;
+        }
+        SDL_SetTextureBlendMode(overlay, SDL_BLENDMODE_BLEND);
+        dirty = true;
+        return true;
+    }
+
+    void destroy()
+    {
+        if (background != NULL) SDL_DestroyTexture(background);
+        if (lights != NULL) SDL_DestroyTexture(lights);
+        if (overlay != NULL) SDL_DestroyTexture(overlay);
+        background = lights = overlay = NULL;
+    }
+
+    static int color_distance(Uint32 c1, Uint32 c2)
+    {
+        int dist = 0;
+        for (int shift = 0; shift < 24; shift += 8)
+        {
+            int d = abs((int)((c1 >> shift) & 0xFF) - (int)((c2 >> shift) & 0xFF));
+            dist = max(dist, d);
+        }
+        return dist;
+    }
+
+    // collects the LEDs whose color differs from what is on the lights texture,
+    // returns true if everything should be redrawn instead. with the LEDs that were shaded
+    // in this frame, only those are compared, the others still have the color they were
+    // compared with last time
+    bool collect_changes(std::vector<Pixel> &P, const DirtyBitmap *shaded = NULL)
+    {
+        changed.clear();
+        if (dirty || drawn.size() != P.size())
+        {
+            drawn.resize(P.size());
+            changed.reserve(P.size());
+            return true;
+        }
+        if (shaded != NULL && shaded->size == P.size())
+        {
+            shaded->visit([&](int p)
+            {
+                if (color_distance(drawn[p], LEDColor(P[p].L)) > PREVIEW_COLOR_THRESHOLD)
+                {
+                    changed.push_back(p);
+                }
+            });
+            return changed.size() > PREVIEW_FULL_REDRAW_FRACTION * P.size();
+        }
+        for (int p = 0; p < P.size(); p++)
+        {
+            if (color_distance(drawn[p], LEDColor(P[p].L)) > PREVIEW_COLOR_THRESHOLD)
+            {
+                changed.push_back(p);
+            }
+        }
+        return changed.size() > PREVIEW_FULL_REDRAW_FRACTION * P.size();
+    }
+};
+
+// collects many outlines into one SDL_RenderGeometry call, every edge being a thin quad
+struct OutlineBatch
+{
+    std::vector<SDL_Vertex> vertices;
+    std::vector<int> indices;
+
+    void clear()
+    {
+        vertices.clear();
+        indices.clear();
+    }
+
+    void add_outline(vec2 corners[4], Uint8 r, Uint8 g, Uint8 b, Uint8 a)
+    {
+        SDL_Color color = {r, g, b, a};
+        for (int c = 0; c < 4; c++)
+        {
+            vec2 from = corners[c];
+            vec2 to = corners[(c + 1) % 4];
+            float length = from.get_distance_to(to);
+            if (length < 1e-3)
+            {
+                continue;
+            }
+            float nx = (from.y - to.y) / length * OUTLINE_THICKNESS;
+            float ny = (to.x - from.x) / length * OUTLINE_THICKNESS;
+            int first = vertices.size();
+            SDL_Vertex v;
+            v.color = color;
+            v.tex_coord.x = v.tex_coord.y = 0;
+            v.position.x = from.x + nx; v.position.y = from.y + ny; vertices.push_back(v);
+            v.position.x = from.x - nx; v.position.y = from.y - ny; vertices.push_back(v);
+            v.position.x = to.x - nx;   v.position.y = to.y - ny;   vertices.push_back(v);
+            v.position.x = to.x + nx;   v.position.y = to.y + ny;   vertices.push_back(v);
+            indices.push_back(first);
+            indices.push_back(first + 1);
+            indices.push_back(first + 2);
+            indices.push_back(first);
+            indices.push_back(first + 2);
+            indices.push_back(first + 3);
+        }
+    }
+
+    void draw(SDL_Renderer *renderer)
+    {
+        if (!indices.empty())
+        {
+            SDL_RenderGeometry(renderer, NULL, &vertices[0], vertices.size(), &indices[0], indices.size());
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,279 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// per stage frame timers, only compiled in with -DSHADY_PROFILE (make profile).
+// every thread writes its own ring buffer, readers only look at the write counters,
+// so recording a sample never takes a lock. with --trace the same spans also go to
+// a Chrome trace file, see trace.h
+
+enum ProfileStage
+{
+    STAGE_FRAME,
+    STAGE_INPUT,
+    STAGE_EDITOR,
+    STAGE_PROCEED,
+    STAGE_SHADE,
+    STAGE_BACKGROUND,
+    STAGE_STRIPS,
+    STAGE_LIGHTS,
+    STAGE_PRESENT,
+    STAGE_COUNT
+};
+
+#ifdef SHADY_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "trace.h"
+
+#define PROFILE_RING_SIZE 512
+
+const char* profile_stage_names[STAGE_COUNT] = {"frame", "input", "editor", "proceed", "shade", "background", "strips", "lights", "present"};
+
+inline long long profile_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct ProfileRing
+{
+    std::atomic<unsigned> written[STAGE_COUNT];
+    std::atomic<long long> samples[STAGE_COUNT][PROFILE_RING_SIZE];
+    long long started[STAGE_COUNT];
+    ProfileRing *next;
+
+    ProfileRing() : next(NULL)
+    {
+        for (int s = 0; s < STAGE_COUNT; s++)
+        {
+            written[s].store(0);
+            started[s] = 0;
+        }
+    }
+
+    void record(int stage, long long start, long long ns)
+    {
+        unsigned n = written[stage].load(std::memory_order_relaxed);
+        samples[stage][n % PROFILE_RING_SIZE].store(ns, std::memory_order_relaxed);
+        written[stage].store(n + 1, std::memory_order_release);
+        if (tracer.active.load(std::memory_order_relaxed))
+        {
+            tracer.record(profile_stage_names[stage], 'X', start, ns);
+        }
+    }
+};
+
+std::atomic<ProfileRing*> profile_rings(NULL);
+
+// the calling thread's ring, created and linked into the global list on first use
+inline ProfileRing& profile_ring()
+{
+    thread_local ProfileRing *ring = NULL;
+    if (ring == NULL)
+    {
+        ring = new ProfileRing();
+        ring->next = profile_rings.load();
+        while (!profile_rings.compare_exchange_weak(ring->next, ring));
+    }
+    return *ring;
+}
+
+struct ProfileScope
+{
+    int stage;
+    long long start;
+    ProfileScope(int stage) : stage(stage), start(profile_now_ns()) {}
+    ~ProfileScope() {profile_ring().record(stage, start, profile_now_ns() - start);}
+};
+
+// spans that are not one of the main loop stages only go to the trace
+struct TraceScope
+{
+    const char *name;
+    long long start;
+    TraceScope(const char *name) : name(name), start(tracer.active.load(std::memory_order_relaxed) ? profile_now_ns() : 0) {}
+    ~TraceScope()
+    {
+        if (start != 0)
+        {
+            tracer.record(name, 'X', start, profile_now_ns() - start);
+        }
+    }
+};
+
+inline void trace_flow(char phase)
+{
+    if (phase == 's')
+    {
+        tracer.frame++;
+    }
+    if (tracer.active.load(std::memory_order_relaxed))
+    {
+        tracer.record("frame", phase, profile_now_ns(), 0);
+    }
+}
+
+// shading time per pattern and shader branch (--attribute). the shader names the branch
+// it took with SHADER_BRANCH("..."), the main loop times every call
+#define ATTRIBUTION_MAX_BRANCHES 32
+
+struct BranchCost
+{
+    int pattern;
+    const char *branch;
+    long long ns;
+    long long calls;
+};
+
+struct BranchAttribution
+{
+    bool enabled = false;
+    const char *branch = "";
+    long long started = 0;
+    long long overhead = 0;
+    int count = 0;
+    BranchCost costs[ATTRIBUTION_MAX_BRANCHES];
+
+    // what two clock reads cost without anything in between, subtracted from every call
+    void calibrate()
+    {
+        long long best = -1;
+        for (int i = 0; i < 1000; i++)
+        {
+            long long a = profile_now_ns();
+            long long b = profile_now_ns();
+            if (best < 0 || b - a < best)
+            {
+                best = b - a;
+            }
+        }
+        overhead = best;
+    }
+
+    void record(int pattern, long long ns)
+    {
+        int i = 0;
+        while (i < count && (costs[i].pattern != pattern || costs[i].branch != branch))
+        {
+            i++;
+        }
+        if (i == count)
+        {
+            if (count == ATTRIBUTION_MAX_BRANCHES)
+            {
+                return;
+            }
+            costs[i].pattern = pattern;
+            costs[i].branch = branch;
+            costs[i].ns = costs[i].calls = 0;
+            count++;
+        }
+        costs[i].ns += max(ns - overhead, 0LL);
+        costs[i].calls++;
+        branch = "";
+    }
+
+    void report()
+    {
+        long long total = 0;
+        for (int i = 0; i < count; i++)
+        {
+            total += costs[i].ns;
+        }
+        printf("shading cost by pattern and branch (clock overhead %lld ns subtracted):\n", overhead);
+        for (int i = 0; i < count; i++)
+        {
+            printf("    pattern %i \t %-12s \t %12lld pixels \t %8.1f ns/pixel \t %5.1f %%\n", costs[i].pattern, costs[i].branch, costs[i].calls,
+                   (double)costs[i].ns / costs[i].calls, total > 0 ? 100. * costs[i].ns / total : 0.);
+        }
+    }
+};
+
+BranchAttribution attribution;
+
+struct ProfileStats
+{
+    float p50[STAGE_COUNT];
+    float p99[STAGE_COUNT];
+    float fps;
+    std::vector<long long> values; // kept between collects, so that the HUD does not allocate
+};
+
+// percentiles in ms over the most recent samples of all threads
+void profile_collect(ProfileStats &stats)
+{
+    std::vector<long long> &values = stats.values;
+    int rings = 0;
+    for (ProfileRing *ring = profile_rings.load(std::memory_order_acquire); ring != NULL; ring = ring->next)
+    {
+        rings++;
+    }
+    values.reserve(rings * PROFILE_RING_SIZE);
+    for (int s = 0; s < STAGE_COUNT; s++)
+    {
+        values.clear();
+        for (ProfileRing *ring = profile_rings.load(std::memory_order_acquire); ring != NULL; ring = ring->next)
+        {
+            unsigned n = min(ring->written[s].load(std::memory_order_acquire), (unsigned)PROFILE_RING_SIZE);
+            for (unsigned i = 0; i < n; i++)
+            {
+                values.push_back(ring->samples[s][i].load(std::memory_order_relaxed));
+            }
+        }
+        stats.p50[s] = stats.p99[s] = 0;
+        if (values.empty())
+        {
+            continue;
+        }
+        std::sort(values.begin(), values.end());
+        stats.p50[s] = 1e-6 * values[values.size() / 2];
+        stats.p99[s] = 1e-6 * values[(values.size() * 99) / 100];
+    }
+    stats.fps = stats.p50[STAGE_FRAME] > 0 ? 1000. / stats.p50[STAGE_FRAME] : 0;
+}
+
+void profile_draw_hud(SDL_Renderer *renderer, ProfileStats &stats)
+{
+    char line[64];
+    SDL_Rect box = {4, 4, 216, 14 + 10 * STAGE_COUNT};
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 180);
+    SDL_RenderFillRect(renderer, &box);
+    snprintf(line, sizeof(line), "%6.1f fps     p50 ms  p99 ms", stats.fps);
+    stringColor(renderer, 8, 8, line, RGB(255, 255, 255));
+    for (int s = 0; s < STAGE_COUNT; s++)
+    {
+        snprintf(line, sizeof(line), "%-10s %7.3f %7.3f", profile_stage_names[s], stats.p50[s], stats.p99[s]);
+        stringColor(renderer, 8, 18 + 10 * s, line, RGB(200, 200, 200));
+    }
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(stage) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(stage)
+#define PROFILE_BEGIN(stage) profile_ring().started[stage] = profile_now_ns()
+#define PROFILE_END(stage) profile_ring().record(stage, profile_ring().started[stage], profile_now_ns() - profile_ring().started[stage])
+#define TRACE_SCOPE(name) TraceScope PROFILE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_FRAME_BEGIN() trace_flow('s')
+#define TRACE_FRAME_END() trace_flow('f')
+#define SHADER_BRANCH(name) attribution.branch = name
+#define ATTRIBUTE_BEGIN() if (attribution.enabled) attribution.started = profile_now_ns()
+#define ATTRIBUTE_END(pattern) if (attribution.enabled) attribution.record(pattern, profile_now_ns() - attribution.started)
+
+#else
+
+#define PROFILE_SCOPE(stage)
+#define PROFILE_BEGIN(stage)
+#define PROFILE_END(stage)
+#define TRACE_SCOPE(name)
+#define TRACE_FRAME_BEGIN()
+#define TRACE_FRAME_END()
+#define SHADER_BRANCH(name)
+#define ATTRIBUTE_BEGIN()
+#define ATTRIBUTE_END(pattern)
+
+#endif
+
+#endif
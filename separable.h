@@ -0,0 +1,98 @@
+#ifndef SEPARABLE_H
+#define SEPARABLE_H
+
+// shaders that only depend on one axis or one attribute of the LED. a pattern declares per
+// type of LED what its shader reads, the LEDs with the same type and the same (quantized)
+// value of it are grouped once per layout, and every frame the shader runs once per group,
+// at its first LED when the color is first needed, and the color is copied to the others.
+// on a matrix shaded by height that is once per row instead of once per LED.
+//
+// u and v are quantized to 1 / SEPARABLE_STEPS, rows that are not exactly level still fall
+// into one group, at the price of colors that may be a step off for the LEDs away from the
+// first one. like the attribute planes the groups belong to one layout, invalidate() when
+// it changed
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+enum ShaderAxis
+{
+    AXIS_ALL,       // needs the whole LED, shaded on its own
+    AXIS_NONE,      // the same for all LEDs of the type
+    AXIS_U,
+    AXIS_V,
+    AXIS_INDEX      // the LED's number within its segment
+};
+
+#define SEPARABLE_STEPS 4096
+
+// what the LEDs of a group have in common, -1 for AXIS_ALL
+inline long long separable_key(int axis, int type, float u, float v, int index)
+{
+    if (axis == AXIS_ALL)
+    {
+        return -1;
+    }
+    long long value = axis == AXIS_U ? llround(u * SEPARABLE_STEPS) : axis == AXIS_V ? llround(v * SEPARABLE_STEPS) : axis == AXIS_INDEX ? index : 0;
+    return (long long)axis << 56 | (long long)(type & 0xff) << 48 | (value & 0xffffffffffffLL);
+}
+
+struct SeparableGroups
+{
+    bool built = false;
+    int pattern = -1;
+    std::vector<int> group;     // per LED, or -1 when it is shaded on its own
+    std::vector<int> first;     // per group, the LED it is shaded at
+    std::vector<LED> color;     // per group, in this frame
+    std::vector<int> shaded;    // per group, the frame color was shaded in
+    int frame = 0;
+    std::vector<std::pair<long long, int>> keys;
+
+    void invalidate() {built = false;}
+
+    // a new frame, no color shaded yet
+    void begin() {frame++;}
+
+    // true the first time group g is asked for in a frame, its color is to be shaded then
+    bool needs(int g)
+    {
+        if (shaded[g] == frame)
+        {
+            return false;
+        }
+        shaded[g] = frame;
+        return true;
+    }
+
+    // key(i) is separable_key of LED i
+    template<typename K> void build(int pattern_, int count, K key)
+    {
+        pattern = pattern_;
+        keys.clear();
+        group.assign(count, -1);
+        first.clear();
+        for (int i = 0; i < count; i++)
+        {
+            long long k = key(i);
+            if (k >= 0)
+            {
+                keys.push_back(std::make_pair(k, i));
+            }
+        }
+        std::sort(keys.begin(), keys.end());
+        for (int k = 0; k < keys.size(); k++)
+        {
+            if (k == 0 || keys[k].first != keys[k - 1].first)
+            {
+                first.push_back(keys[k].second);
+            }
+            group[keys[k].second] = first.size() - 1;
+        }
+        color.resize(first.size());
+        shaded.assign(first.size(), frame);
+        built = true;
+    }
+};
+
+#endif
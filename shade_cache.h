@@ -0,0 +1,137 @@
+#ifndef SHADE_CACHE_H
+#define SHADE_CACHE_H
+
+// incremental shading. large parts of a show stay the same from one frame to the next, the
+// water of the tie sits at its background between the drops. a pattern names the inputs of
+// its shader every frame (the drops, the phases of the spiral, ...) and tells per LED which
+// of them its color depends on. LEDs whose inputs are the same as in the last frame keep
+// their color, the others are shaded again and marked in a bitmap, so that the preview and
+// the outputs only look at those.
+//
+// a color is shaded again when an input it depended on or depends on now changed, so an LED
+// a drop just left gets its background back. like the attribute planes the cache belongs to
+// one layout, invalidate() when it changed
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+// values the inputs of a pattern can have in total, and inputs (one bit each)
+#define SHADE_INPUT_VALUES 64
+#define SHADE_INPUTS 32
+
+// one bit per LED
+struct DirtyBitmap
+{
+    std::vector<uint64_t> words;
+    int size = 0;
+    int count = 0;      // set bits
+
+    void resize(int n)
+    {
+        size = n;
+        words.assign((n + 63) / 64, 0);
+        count = 0;
+    }
+
+    void clear()
+    {
+        std::fill(words.begin(), words.end(), 0);
+        count = 0;
+    }
+
+    void set(int i)
+    {
+        words[i >> 6] |= (uint64_t)1 << (i & 63);
+        count++;
+    }
+
+    bool test(int i) const {return (words[i >> 6] >> (i & 63)) & 1;}
+
+    // f(i) for every set bit, in order
+    template<typename F> void visit(F f) const
+    {
+        for (int w = 0; w < words.size(); w++)
+        {
+            for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1)
+            {
+                f(64 * w + __builtin_ctzll(bits));
+            }
+        }
+    }
+};
+
+// the values of the inputs in the order the pattern adds them, compared with the last frame's
+struct ShadeInputs
+{
+    float value[SHADE_INPUT_VALUES];
+    float last[SHADE_INPUT_VALUES];
+    int count = 0;
+    int last_count = -1;
+    unsigned changed = 0;
+
+    void begin()
+    {
+        count = 0;
+        changed = 0;
+    }
+
+    void add(int input, float v)
+    {
+        if (count >= SHADE_INPUT_VALUES)
+        {
+            changed = ~0u;
+            return;
+        }
+        if (count >= last_count || last[count] != v)
+        {
+            changed |= 1u << input;
+        }
+        value[count++] = v;
+    }
+
+    // a pattern that added other values than last time changed everything
+    void end()
+    {
+        if (count != last_count)
+        {
+            changed = ~0u;
+        }
+        memcpy(last, value, count * sizeof(float));
+        last_count = count;
+    }
+
+    void forget() {last_count = -1;}
+};
+
+struct ShadeCache
+{
+    bool valid = false;
+    int pattern = -1;
+    ShadeInputs inputs;
+    std::vector<unsigned> depends;  // per LED, the inputs its color depends on
+    DirtyBitmap dirty;              // the LEDs shaded in the last frame
+
+    void invalidate() {valid = false;}
+
+    // for count LEDs shaded with pattern, nothing cached yet
+    void reset(int pattern_, int count)
+    {
+        pattern = pattern_;
+        depends.assign(count, ~0u);
+        dirty.resize(count);
+        inputs.forget();
+        valid = true;
+    }
+
+    // true when LED i has to be shaded again, now are the inputs it depends on in this frame
+    bool stale(int i, unsigned now)
+    {
+        bool shade = ((depends[i] | now) & inputs.changed) != 0;
+        depends[i] = now;
+        return shade;
+    }
+};
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef SHADER_REGION_H
+#define SHADER_REGION_H
+
+// culling for effects that only light up part of the layout. a pattern tells per frame in
+// which region of the uv plane its shader can return something else than one background
+// color, only the LEDs in there are shaded and all others get the background in one pass.
+// the LEDs are found through a uniform grid over their uv positions, built once per layout.
+// unlike SpatialGrid, which keeps editable segments, it is packed into two flat arrays, so a
+// query is a walk over a few cells without hashing or allocating. the grid keeps the LEDs of
+// a cell in the order they are given in, so LEDs sorted along a curve (pixel_order.h) are
+// visited along it
+
+#include <vector>
+#include <cmath>
+
+enum RegionShape
+{
+    REGION_ALL,         // no culling
+    REGION_CIRCLE,
+    REGION_ANNULUS,
+    REGION_BOX
+};
+
+// LEDs per grid cell on average
+#define REGION_GRID_FILL 8
+
+// the distance beyond which exp(-d^2 / width) stays below 1 / 256, where no 8 bit channel of
+// an LED lit with it shows anything anymore
+inline float gaussian_cutoff(float width)
+{
+    return sqrt(width * log(256.));
+}
+
+struct ShaderRegion
+{
+    int shape = REGION_ALL;
+    vec2 center;
+    float inner = 0;    // radius, annulus only
+    float outer = 0;    // radius, circle and annulus
+    vec2 low, high;     // box
+    LED background;
+
+    static ShaderRegion all()
+    {
+        return ShaderRegion();
+    }
+
+    static ShaderRegion circle(vec2 center, float radius, LED background)
+    {
+        return annulus(center, 0, radius, background, REGION_CIRCLE);
+    }
+
+    static ShaderRegion annulus(vec2 center, float inner, float outer, LED background, int shape = REGION_ANNULUS)
+    {
+        ShaderRegion region;
+        region.shape = shape;
+        region.center = center;
+        region.inner = max(inner, 0.f);
+        region.outer = outer;
+        region.low = vec2(center.x - outer, center.y - outer);
+        region.high = vec2(center.x + outer, center.y + outer);
+        region.background = background;
+        return region;
+    }
+
+    static ShaderRegion box(vec2 low, vec2 high, LED background)
+    {
+        ShaderRegion region;
+        region.shape = REGION_BOX;
+        region.low = low;
+        region.high = high;
+        region.background = background;
+        return region;
+    }
+
+    bool contains(float u, float v) const
+    {
+        if (u < low.x || u > high.x || v < low.y || v > high.y)
+        {
+            return false;
+        }
+        if (shape == REGION_BOX)
+        {
+            return true;
+        }
+        float d2 = (u - center.x) * (u - center.x) + (v - center.y) * (v - center.y);
+        return d2 <= outer * outer && d2 >= inner * inner;
+    }
+
+    // false when no point of the cell can be inside
+    bool touches(float u0, float v0, float u1, float v1) const
+    {
+        if (u1 < low.x || u0 > high.x || v1 < low.y || v0 > high.y)
+        {
+            return false;
+        }
+        if (shape != REGION_ANNULUS)
+        {
+            return true;
+        }
+        // cells within the hole of the annulus
+        float far_u = max(fabs(u0 - center.x), fabs(u1 - center.x));
+        float far_v = max(fabs(v0 - center.y), fabs(v1 - center.y));
+        return far_u * far_u + far_v * far_v >= inner * inner;
+    }
+};
+
+struct RegionGrid
+{
+    bool built = false;
+    int columns = 0;
+    int rows = 0;
+    float u0 = 0, v0 = 0;
+    float cell = 1;
+    std::vector<int> start;     // the LEDs of cell c are items[start[c]] to items[start[c + 1] - 1]
+    std::vector<int> items;
+
+    void invalidate() {built = false;}
+
+    // T has the uv position of an LED in u and v
+    template<typename T> void build(const std::vector<T> &points)
+    {
+        int n = points.size();
+        float u1 = 0, v1 = 0;
+        u0 = v0 = 0;
+        for (int i = 0; i < n; i++)
+        {
+            u0 = i == 0 ? points[i].u : min(u0, points[i].u);
+            v0 = i == 0 ? points[i].v : min(v0, points[i].v);
+            u1 = i == 0 ? points[i].u : max(u1, points[i].u);
+            v1 = i == 0 ? points[i].v : max(v1, points[i].v);
+        }
+        float area = max((u1 - u0) * (v1 - v0), 1e-6f);
+        cell = max((float)sqrt(area * REGION_GRID_FILL / max(n, 1)), 1e-4f);
+        columns = (int)((u1 - u0) / cell) + 1;
+        rows = (int)((v1 - v0) / cell) + 1;
+
+        // counting sort of the LEDs by cell
+        start.assign(columns * rows + 1, 0);
+        items.resize(n);
+        for (int i = 0; i < n; i++)
+        {
+            start[cell_of(points[i].u, points[i].v) + 1]++;
+        }
+        for (int c = 0; c < columns * rows; c++)
+        {
+            start[c + 1] += start[c];
+        }
+        std::vector<int> next(start.begin(), start.end() - 1);
+        for (int i = 0; i < n; i++)
+        {
+            items[next[cell_of(points[i].u, points[i].v)]++] = i;
+        }
+        built = true;
+    }
+
+    int cell_of(float u, float v)
+    {
+        int cx = constrain((int)((u - u0) / cell), 0, columns - 1);
+        int cy = constrain((int)((v - v0) / cell), 0, rows - 1);
+        return cy * columns + cx;
+    }
+
+    // f(i) for every LED inside the region. cells are widened a little, so that an LED on the
+    // border of its cell is never skipped because of rounding
+    template<typename T, typename F> void visit(const ShaderRegion &region, const std::vector<T> &points, F f)
+    {
+        float e = cell * 1e-3;
+        int cx0 = max((int)floor((region.low.x - e - u0) / cell), 0);
+        int cy0 = max((int)floor((region.low.y - e - v0) / cell), 0);
+        int cx1 = min((int)floor((region.high.x + e - u0) / cell), columns - 1);
+        int cy1 = min((int)floor((region.high.y + e - v0) / cell), rows - 1);
+        for (int cy = cy0; cy <= cy1; cy++)
+        {
+            for (int cx = cx0; cx <= cx1; cx++)
+            {
+                if (!region.touches(u0 + cx * cell - e, v0 + cy * cell - e, u0 + (cx + 1) * cell + e, v0 + (cy + 1) * cell + e))
+                {
+                    continue;
+                }
+                int c = cy * columns + cx;
+                for (int k = start[c]; k < start[c + 1]; k++)
+                {
+                    int i = items[k];
+                    if (region.contains(points[i].u, points[i].v))
+                    {
+                        f(i);
+                    }
+                }
+            }
+        }
+    }
+};
+
+#endif
@@ -1,16 +1,24 @@
 #include <stdio.h>
 #include <cmath>
+#include <cstring>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL2_gfxPrimitives.h>
 #include <vector>
 #include "LED_WS.h"
 #include "pixel.h"
 #include "helper.h"
+#include "clock.h"
+#include "phase.h"
+#include "bench.h"
+#include "golden.h"
 
 #define PI 3.141592
 #define numpix P.size()
 
 int count_LEDs_in_cross_matrix(int, int);
+void init_pattern();
+void proceed_pattern();
+void interpolate_pattern(float alpha);
 LED shader(float time, vec2 coord, int pixel, int segment);
 
 const float distance_LED_in_cm = 100. / 60.;
@@ -18,6 +26,8 @@ const float distance_LED_in_m = 0.01 * distance_LED_in_cm;
 
 bool debug = false;
 
+PhaseBank phases;
+
 struct Segment
 {
     float origin_x;
@@ -66,6 +76,8 @@ struct Segment
     }
 };
 
+void shade_frame(std::vector<Pixel> &P, std::vector<Segment> &segments, float time, float width, float height, int selected_segment);
+
 int main(int argc, char* argv[])
 {
     SDL_Event e;
@@ -89,6 +101,17 @@ int main(int argc, char* argv[])
 
     int selected_segment = 0;
 
+    BenchOptions bench;
+    bench.parse(argc, argv);
+    GoldenRun golden;
+    golden.parse(argc, argv);
+
+    if (argc > 1 && !std::strcmp(argv[1], "--soak"))
+    {
+        init_pattern();
+        return soak_phases(phases, argc > 2 ? atof(argv[2]) : 30, SIM_RATE) ? 1 : 0;
+    }
+
     /// PATTERN
 
     segments.clear();
@@ -127,6 +150,40 @@ int main(int argc, char* argv[])
 
     /// END PATTERN
 
+    if (golden.enabled())
+    {
+        srandom(GOLDEN_SEED);
+        init_pattern();
+        for (long frame = 0; frame < golden.frames; frame++)
+        {
+            shade_frame(P, segments, frame, width, height, selected_segment);
+            golden.add("skull", frame, P);
+            proceed_pattern();
+            interpolate_pattern(1);
+        }
+        return golden.finish();
+    }
+
+    if (bench.frames > 0)
+    {
+        BenchSuite suite;
+        BenchTimer timer;
+        long frame = 0;
+        init_pattern();
+        for (; frame < BENCH_WARMUP_FRAMES + bench.frames; frame++)
+        {
+            if (frame == BENCH_WARMUP_FRAMES)
+            {
+                timer = BenchTimer();
+            }
+            shade_frame(P, segments, frame, width, height, selected_segment);
+            proceed_pattern();
+            interpolate_pattern(1);
+        }
+        suite.add_frames("skull", timer, bench.frames, numpix);
+        return bench.finish(suite, argv[0]);
+    }
+
     float meters_required = numpix * distance_LED_in_m;
     printf("Pixels: %i\nMeters: %g\nWidth: %g\nHeight: %g\n", numpix, meters_required, width, height);
 
@@ -176,7 +233,8 @@ int main(int argc, char* argv[])
     float new_origin_x, new_origin_y, new_to_x, new_to_y;
 
     int quit = 0;
-    long time = 0;
+    SimClock clock;
+    init_pattern();
     bool firstClick = true;
     while (!quit)
     {
@@ -331,18 +389,13 @@ int main(int argc, char* argv[])
         }
 
         //////////// PATTERN ////////////
-        P.clear();
-        for (std::vector<Segment>::iterator iseg = segments.begin(); iseg != segments.end(); ++iseg)
+        int steps = clock.advance(SimClock::now());
+        for (int step = 0; step < steps; step++)
         {
-            int segcount = iseg - segments.begin();
-            for (int p = 0; p < iseg->pixels; p++)
-            {
-                Pixel pixel = Pixel(iseg->get_pixel(p), segcount);
-                vec2 relative_coord = vec2(pixel.x/width, pixel.y/height);
-                pixel.L = shader(time, relative_coord, numpix, segcount - selected_segment);
-                P.push_back(pixel);
-            }
+            proceed_pattern();
         }
+        interpolate_pattern(clock.alpha());
+        shade_frame(P, segments, clock.time(), width, height, selected_segment);
 
         //////////// LIGHTS ////////////
         for(int p = 0; p < numpix; p++)
@@ -394,7 +447,6 @@ int main(int argc, char* argv[])
 
         SDL_RenderPresent(renderer);
 //        SDL_Delay(5);
-        time++;
     }
 
     SDL_DestroyRenderer(renderer);
@@ -403,6 +455,7 @@ int main(int argc, char* argv[])
     return 0;
 }
 
+int phase_cube1, phase_cube2;
 float pos0 = 0;
 float pos1 = 0;
 float pos2 = 0;
@@ -411,6 +464,72 @@ float vel0 = 0;
 float vel1 = 0;
 float ang0 = 0;
 float ang1 = 0;
+float ang0_prev = 0;
+float ang1_prev = 0;
+float ang0_shown = 0;
+float ang1_shown = 0;
+
+// the cubes used to turn a little with every LED shaded, this many turns per step keep
+// the speed they had on the 98 LEDs of the skull
+#define CUBE_SPIN_LEDS 98
+
+// a cube starts over at a place and angle seeded with the time it starts at
+void seed_cube1(double time)
+{
+    pos0 = pseudorandom(time);
+    pos1 = pseudorandom(time + 1.);
+    ang0 = 2.*PI*pseudorandom(2.*time);
+}
+
+void seed_cube2(double time)
+{
+    pos2 = pseudorandom(7.*time);
+    pos3 = pseudorandom(7.*time + 1.);
+    ang1 = 2.*PI*pseudorandom(3.*time);
+}
+
+void init_pattern()
+{
+    pos0 = pos1 = pos2 = pos3 = 0;
+    ang0 = ang1 = 0;
+
+    phases.clear();
+    phase_cube1 = phases.add(100., 1.);
+    phase_cube2 = phases.add(167., 1., 83.);
+    seed_cube1(0);
+    ang0_prev = ang0_shown = ang0;
+    ang1_prev = ang1_shown = ang1;
+}
+
+void proceed_pattern()
+{
+    long cycles1 = phases.cycles(phase_cube1);
+    long cycles2 = phases.cycles(phase_cube2);
+    ang0_prev = ang0;
+    ang1_prev = ang1;
+    ang0 += CUBE_SPIN_LEDS * 0.0033 * phases.last(phase_cube1) * 1e-4;
+    ang1 -= CUBE_SPIN_LEDS * 0.0021 * phases.last(phase_cube2) * 1e-4;
+    phases.advance(1);
+
+    if (phases.cycles(phase_cube1) != cycles1)
+    {
+        seed_cube1(100. * phases.cycles(phase_cube1));
+        ang0_prev = ang0;
+    }
+    if (phases.cycles(phase_cube2) != cycles2)
+    {
+        seed_cube2(167. * phases.cycles(phase_cube2) - 83.);
+        ang1_prev = ang1;
+    }
+}
+
+// a reseeded cube starts at its new angle instead of sweeping there
+void interpolate_pattern(float alpha)
+{
+    phases.interpolate(alpha);
+    ang0_shown = ang0_prev + alpha * (ang0 - ang0_prev);
+    ang1_shown = ang1_prev + alpha * (ang1 - ang1_prev);
+}
 
 
 LED shader(float time, vec2 coord, int pixel, int segment)
@@ -426,33 +545,19 @@ LED shader(float time, vec2 coord, int pixel, int segment)
 
   bool wal = true;
 
-  float mod_time = fmod(time, 100.);
-  if(mod_time < .01)
-  {
-    pos0 = pseudorandom(time);
-    pos1 = pseudorandom(time + 1.);
-    ang0 = 2.*PI*pseudorandom(2.*time);
-  }
+  float mod_time = phases.get(phase_cube1);
   float edge1 = .01 * mod_time;
-  ang0 += 0.0033 * mod_time * 1e-4;
   float x = coord.x - pos0;
   float y = coord.y - pos1;
-  float xx =  cos(ang0) * x + sin(ang0) * y;
-  float yy = -sin(ang0) * x + cos(ang0) * y;
+  float xx =  cos(ang0_shown) * x + sin(ang0_shown) * y;
+  float yy = -sin(ang0_shown) * x + cos(ang0_shown) * y;
   float intensity = exp(-15. * fabs( min(edge1-fabs(xx), edge1-fabs(yy)) )) * (smoothstep(0,10,mod_time) - smoothstep(80, 100, mod_time));
   LED cube1 = wal ? LED(250, 0, .6 * intensity) : LED(266, .3, intensity);
 
-  float mod_time2 = fmod(time + 83., 167.);
-  if(mod_time2 < .02)
-  {
-    pos2 = pseudorandom(7.*time);
-    pos3 = pseudorandom(7.*time + 1.);
-    ang1 = 2.*PI*pseudorandom(3.*time);
-  }
+  float mod_time2 = phases.get(phase_cube2);
   float edge2 = .004 * (mod_time2);
-  ang1 -= 0.0021 * mod_time2 * 1e-4;
-  x =  cos(ang1) * coord.x + sin(ang1) * coord.y - pos2;
-  y = -sin(ang1) * coord.x + cos(ang1) * coord.y - pos3;
+  x =  cos(ang1_shown) * coord.x + sin(ang1_shown) * coord.y - pos2;
+  y = -sin(ang1_shown) * coord.x + cos(ang1_shown) * coord.y - pos3;
   intensity = exp(-12.4 * fabs( min(edge2-fabs(x), edge2-fabs(y)) )) * (smoothstep(0,10,mod_time) - smoothstep(140, 167, mod_time2));
   LED cube2 = wal ? LED(166, .2, intensity) : LED(111, 0, intensity);
 
@@ -594,3 +699,29 @@ LED shader(float time, vec2 coord, int pixel, int segment)
     }
 }
 */
+
+void shade_frame(std::vector<Pixel> &P, std::vector<Segment> &segments, float time, float width, float height, int selected_segment)
+{
+    // P keeps its storage from frame to frame, it only grows when the layout did
+    int count = 0;
+    for (std::vector<Segment>::iterator iseg = segments.begin(); iseg != segments.end(); ++iseg)
+    {
+        count += iseg->pixels;
+    }
+    P.resize(count);
+    int i = 0;
+    for (std::vector<Segment>::iterator iseg = segments.begin(); iseg != segments.end(); ++iseg)
+    {
+        int segcount = iseg - segments.begin();
+        for (int p = 0; p < iseg->pixels; p++, i++)
+        {
+            Pixel &pixel = P[i];
+            vec2 coord = iseg->get_pixel(p);
+            pixel.x = coord.x;
+            pixel.y = coord.y;
+            pixel.segcount = segcount;
+            vec2 relative_coord = vec2(pixel.x/width, pixel.y/height);
+            pixel.L = shader(time, relative_coord, i, segcount - selected_segment);
+        }
+    }
+}
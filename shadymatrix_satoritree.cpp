@@ -7,25 +7,53 @@
 #include "LED_WS.h"
 #include "pixel.h"
 #include "helper.h"
+#include "viewport.h"
+#include "preview.h"
+#include "spatial_grid.h"
+#include "clock.h"
+#include "phase.h"
+#include "profiler.h"
+#include "perf_counters.h"
+#include "metrics.h"
+#include "latency.h"
+#include "bench.h"
+#include "synthetic_layout.h"
+#include "golden.h"
+#include "layout_file.h"
+#include "baked_layout.h"
+#include "pixel_attributes.h"
+#include "pixel_order.h"
+#include "shader_region.h"
+#include "shade_cache.h"
+#include "separable.h"
 
 #define PI 3.141592
 #define numpix P.size()
 
-const float distance_LED_in_cm = 100. / 60.;
+constexpr float distance_LED_in_cm = 100. / 60.;
 const float distance_LED_in_m = 0.01 * distance_LED_in_cm;
 
-const float originOffsetX = 16;
-const float originOffsetY = 16;
+constexpr float originOffsetX = 16;
+constexpr float originOffsetY = 16;
 
 const int nr_of_patterns = 2;
 
+const float segment_index_cell = 2.;
+const float segment_pick_radius = 1.5;
+
+// where RETURN writes the layout when it was not loaded with --layout
+const char *default_layout_path = "satoritree.layout";
+
 struct Segment
 {
     float origin_x;
     float origin_y;
     float direction; // 0 to 360 degrees
+    double dir_cos, dir_sin;
     int pixels;
     int type = 0;
+    vec2 outline[4];
+    float outline_width = -1; // strip width the outline was computed for, -1 when outdated
     Segment(float x, float y, float to_x, float to_y) {set(x, y, to_x, to_y);}
     Segment(float x, float y, float to_x, float to_y, int _type) {set(x, y, to_x, to_y); type = _type;}
     void set(float x, float y, float to_x, float to_y)
@@ -38,31 +66,60 @@ struct Segment
         set_direction_to(to_x, to_y);
         set_length_to(to_x, to_y);
     }
-    void set_origin(float x, float y) {origin_x = x; origin_y = y;}
-    void set_direction(float dir) {direction = fmod(dir + 360., 360.);}
+    void set_origin(float x, float y) {origin_x = x; origin_y = y; outline_width = -1;}
+    void set_direction(float dir)
+    {
+        direction = fmod(dir + 360., 360.);
+        dir_cos = cos(direction * PI/180.);
+        dir_sin = sin(direction * PI/180.);
+        outline_width = -1;
+    }
     void set_direction_to(float to_x, float to_y) {set_direction(180./PI*atan2(origin_y - to_y, to_x - origin_x));}
-    void set_length(float l) {pixels = (int)(round((l + 1) / distance_LED_in_cm));}
+    void set_length(float l) {pixels = (int)(round((l + 1) / distance_LED_in_cm)); outline_width = -1;}
     void set_length_to(float to_x, float to_y) {set_length(sqrt(pow(to_x - origin_x, 2) + pow(to_y - origin_y, 2)));}
     float get_length() {return pixels * distance_LED_in_cm;}
     vec2 get_pixel(int i)
     {
         return vec2(
-            origin_x + i * distance_LED_in_cm * cos(direction * PI/180.),
-            origin_y - i * distance_LED_in_cm * sin(direction * PI/180.)
+            origin_x + i * distance_LED_in_cm * dir_cos,
+            origin_y - i * distance_LED_in_cm * dir_sin
         );
     }
+    vec2* get_outline(float strip_width)
+    {
+        if (outline_width != strip_width)
+        {
+            float L2 = .5 * distance_LED_in_cm;
+            float H2 = .5 * strip_width;
+            vec2 last = get_last_pixel();
+            outline[0] = vec2(origin_x - dir_cos * L2 + dir_sin * H2, origin_y + dir_sin * L2 + dir_cos * H2);
+            outline[1] = vec2(origin_x - dir_cos * L2 - dir_sin * H2, origin_y + dir_sin * L2 - dir_cos * H2);
+            outline[2] = vec2(last.x + dir_cos * L2 - dir_sin * H2, last.y - dir_sin * L2 - dir_cos * H2);
+            outline[3] = vec2(last.x + dir_cos * L2 + dir_sin * H2, last.y - dir_sin * L2 + dir_cos * H2);
+            outline_width = strip_width;
+        }
+        return outline;
+    }
     vec2 get_last_pixel_plus_one() {return get_pixel(pixels);}
     vec2 get_last_pixel() {return get_pixel(pixels - 1);}
+    float get_distance_to(vec2 v)
+    {
+        float along = (v.x - origin_x) * dir_cos - (v.y - origin_y) * dir_sin;
+        along = constrain(along, 0, (pixels - 1) * distance_LED_in_cm);
+        return v.get_distance_to(vec2(origin_x + along * dir_cos, origin_y - along * dir_sin));
+    }
     float get_rightmost_x() {return direction > 90 && direction < 270 ? origin_x : get_last_pixel_plus_one().x;}
     float get_bottommost_y() {return direction < 180 ? origin_y : get_last_pixel_plus_one().y;}
 
     void move_horizontally(float inc)
     {
         origin_x += inc;
+        outline_width = -1;
     }
     void move_vertically(float inc)
     {
         origin_y += inc;
+        outline_width = -1;
     }
     void turn(float inc)
     {
@@ -71,6 +128,7 @@ struct Segment
     void change_length(int inc)
     {
         pixels = max(pixels + inc, 1);
+        outline_width = -1;
     }
     void flip()
     {
@@ -79,14 +137,206 @@ struct Segment
     }
 };
 
+// the commands before CMD_SELECT change the layout
+enum EditorCommandType
+{
+    CMD_CLICK,
+    CMD_REMOVE_LAST,
+    CMD_CLEAR,
+    CMD_MOVE,
+    CMD_TURN,
+    CMD_CHANGE_LENGTH,
+    CMD_FLIP,
+    CMD_SWAP_NEXT,
+    CMD_SWAP_PREVIOUS,
+    CMD_SELECT,
+    CMD_SELECT_AT,
+    CMD_SELECT_BOX,
+    CMD_EXPORT,
+    CMD_NEXT_PATTERN,
+    CMD_QUIT
+};
+
+// input is decoded into these and applied all at once at the start of a frame
+struct EditorCommand
+{
+    EditorCommandType type;
+    float x = 0;
+    float y = 0;
+    float x2 = 0;
+    float y2 = 0;
+    int n = 0;
+    EditorCommand() : type(CMD_QUIT) {}
+    EditorCommand(EditorCommandType type) : type(type) {}
+    EditorCommand(EditorCommandType type, float x, float y) : type(type), x(x), y(y) {}
+    EditorCommand(EditorCommandType type, int n) : type(type), n(n) {}
+    EditorCommand(EditorCommandType type, float x, float y, float x2, float y2) : type(type), x(x), y(y), x2(x2), y2(y2) {}
+    bool edits_layout() {return type < CMD_SELECT;}
+};
+
 int count_LEDs_in_cross_matrix(int, int);
 void init_pattern();
 void proceed_pattern(float time);
+void interpolate_pattern(float alpha);
 LED shader(int pattern, float time, vec2 coord, int pixel, int segment, int type);
-void print_all_segments(std::vector<Segment> segments);
+void shade_frame(std::vector<Pixel> &P, std::vector<Segment> &segments, int pattern, float time, float width, float height, int selected_segment);
+template<int N> void shade_baked(std::vector<Pixel> &P, const BakedTable<N> &table, int pattern, float time, int selected_segment);
+void shade_mapped(std::vector<Pixel> &P, LayoutFile &layout, int figure, int pattern, float time, float width, float height, int selected_segment);
+void shade_figure(std::vector<Pixel> &P, std::vector<Segment> &segments, int stored_figure, int pattern, float time, float width, float height, int selected_segment);
+void shade_ordered(int pattern, float time, int selected_segment);
+bool shade_sequence(std::vector<Pixel> &P, std::vector<Segment> &segments, int pattern, float time, float width, float height, int selected_segment);
+ShaderRegion shader_region(int pattern);
+vec2 rocket_position();
+void shader_inputs(int pattern, int selected_segment, ShadeInputs &inputs);
+unsigned shader_depends(int pattern, vec2 coord, int type);
+float drop_offset(int p, float y);
+int shader_axis(int pattern, int type);
+void invalidate_layout();
+void bench_scale(BenchSuite &suite, BenchOptions &bench);
+void print_all_segments(std::vector<Segment> &segments);
+void draw_glow(SDL_Renderer *renderer, float x, float y, float size, LED L);
+bool decode_event(SDL_Event &e, Viewport &view, EditorCommand &command);
+void index_segment(SpatialGrid &grid, Segment &segment, int id);
+int pick_segment(SpatialGrid &grid, std::vector<Segment> &segments, vec2 coord, std::vector<int> &candidates);
+void print_segment_info(std::vector<Segment> &segments, int s, float width, float height);
 
 bool debug = false;
 
+PhaseBank phases;
+
+// the planes the shader of each pattern reads, computed once per layout
+const unsigned pattern_attributes[nr_of_patterns] = {ATTR_POLAR, 0};
+PixelAttributes attributes(vec2(.5, .5), PI);
+PixelOrder shading_order;
+RegionGrid region_grid;
+bool culling = true;
+ShadeCache shade_cache;
+bool incremental = false;
+SeparableGroups separable;
+bool separable_shading = false;
+LayoutFile *mapped_layout = NULL;   // the layout file loaded with --layout
+
+//////// FIGURES ////////
+
+// x, y, to_x, to_y as they are passed to Segment, like the editor prints them
+constexpr BakedSegment satoritree_figure1[] =
+{
+    {-2.3, -7, -3.5, -8.3},
+    {-5, -9.4, -8, -10.6},
+    {-9.9, -10.2, -12.4, -8},
+    {-12.6, -6.8, -10, -8.8},
+    {-7.7, -9.3, -6.2, -8.8},
+    {-3.6, -7, -3.6, -7},
+    {-5, -4.6, -8.3, -4.5},
+    {-10.5, -3.5, -13.7, 0.4},
+    {-14.1, 2.3, -13.8, 5.7},
+    {-12.3, 4.7, -12.6, 2.9},
+    {-12.2, 0.4, -10.3, -2.2},
+    {-7.6, -3.5, -4.2, -3.6},
+    {-0.8, -3, 0.8, -2.9, 1},
+    {0, -1.8, 0, -1.8, 1},
+    {-0.6, 0.9, -1.5, 14.1, 1},
+    {0, 15.3, 0, 15.3, 1},
+    {1.5, 14.1, 0.6, 0.9, 1},
+    {5.2, -1.9, 6.8, -1.3},
+    {9, 0.5, 9.8, 1.9},
+    {11.1, 2.3, 9.5, -0.6},
+    {8, -1.9, 5, -3.2},
+    {5.9, -5.8, 7.4, -6.5},
+    {9.8, -6.6, 9.8, -6.6},
+    {11.8, -4.4, 13.2, -1.3},
+    {14.4, -1, 12.2, -5.6},
+    {11, -7.1, 9.5, -7.8},
+    {7.6, -7.8, 4.7, -6.2},
+    {2, -7.4, 2.7, -8.9},
+    {4.7, -10.4, 6.4, -10.6},
+    {7.1, -11.7, 3.8, -11.3},
+    {2.4, -10.2, 0.8, -7.1},
+    {1.7, -4, -1.7, -4.2, 1},
+};
+
+constexpr BakedSegment satoritree_figure2[] =
+{
+    {-3.1, -7.4, -3.8, -8.9},
+    {-5.3, -10, -8.8, -10.2},
+    {-10.5, -9.5, -12.7, -7},
+    {-11.1, -7, -9.8, -8},
+    {-7.8, -8.2, -6.2, -7.8},
+    {-4.2, -7, -4.2, -7},
+    {-4.6, -3, -7.9, -3},
+    {-9.9, -2.3, -12.7, -0.5},
+    {-13.6, 1.1, -14, 6},
+    {-12.8, 4.9, -11.4, 1.9},
+    {-10, 0.5, -8.6, -0.3},
+    {-7, -1.7, -5.4, -1.8},
+    {-0.8, -2.9, 0.8, -2.9, 2},
+    {0, -1.8, 0, -1.8, 2},
+    {-0.8, 0.7, -1.6, 13.9, 2},
+    {0, 15.5, 0, 15.5, 2},
+    {1.6, 13.9, 0.8, 0.7, 2},
+    {5.2, -1.8, 6.4, -0.7},
+    {7.7, 0.7, 8.5, 2.1},
+    {10.1, 3.2, 9.2, 0},
+    {8, -1.6, 5.2, -3.2},
+    {1.7, -4, -1.7, -4.1, 2},
+    {4.4, -6, 6, -6.5},
+    {8, -6.7, 8, -6.7},
+    {9.8, -6, 12.6, -4.3},
+    {14.4, -4, 11.1, -7.8},
+    {9.5, -8.8, 7.9, -9},
+    {6, -8.6, 3.2, -6.8},
+    {0.8, -8.3, 1.3, -10},
+    {2.1, -11.7, 3.1, -13},
+    {2.8, -14.4, 0.4, -12.2},
+    {-0.3, -10.4, -0.4, -7.1},
+};
+
+constexpr BakedSegment satoritree_figure3[] =
+{
+    {1.3, -7.5, 1.6, -10.8},
+    {0.8, -12.7, -2, -14.5},
+    {-1.8, -12.9, -0.7, -11.8},
+    {0.1, -10.1, 0.2, -8.4},
+    {-2.8, -7.6, -4, -8.9},
+    {-5.7, -9.6, -8.9, -9.3},
+    {-10.8, -8.6, -13.3, -6.6},
+    {-13.1, -5.6, -10.1, -6.9},
+    {-8, -7.5, -6.3, -7.7},
+    {-4.4, -7.3, -4.4, -7.3},
+    {-4.6, -4.1, -8.8, -3.4},
+    {-9.5, -2.6, -13.2, 0.9},
+    {-14.1, 2.6, -14.1, 6},
+    {-12.8, 4.9, -12.4, 3.3},
+    {-11.4, 1.7, -9, -0.6},
+    {-7.2, -1.7, -5.6, -2.5},
+    {-1, -3.2, 0.8, -3.1, 3},
+    {0, -2, 0, -2, 3},
+    {-0.7, 0.4, -1.6, 13.8, 3},
+    {0, 15.5, 0, 15.5, 3},
+    {1.4, 13.8, 0.6, 0.5, 3},
+    {4.8, -2.4, 6.3, -1.9},
+    {8, -0.8, 9.2, 0.4},
+    {11, 1, 9.3, -1.8},
+    {7.8, -3, 4.5, -3.5},
+    {1.7, -4.2, -1.7, -4.2, 3},
+    {6, -6.7, 7.6, -7.3},
+    {9.7, -7.5, 9.7, -7.5},
+    {11.4, -6.7, 13.3, -4},
+    {14.8, -3.6, 12.8, -8},
+    {10.8, -9.3, 9.2, -9.4},
+    {7.3, -9, 4.5, -7.2},
+};
+
+constexpr float figure_width = 32;
+constexpr float figure_height = 32;
+constexpr BakedGeometry satoritree_geometry = {distance_LED_in_cm, originOffsetX, originOffsetY, PI};
+
+#ifdef BAKED_LAYOUT
+BAKE_FIGURE(baked_figure1, satoritree_figure1, satoritree_geometry, figure_width, figure_height);
+BAKE_FIGURE(baked_figure2, satoritree_figure2, satoritree_geometry, figure_width, figure_height);
+BAKE_FIGURE(baked_figure3, satoritree_figure3, satoritree_geometry, figure_width, figure_height);
+#endif
+
 int main(int argc, char* argv[])
 {
     SDL_Event e;
@@ -100,8 +350,8 @@ int main(int argc, char* argv[])
     const float A = N * D;
     const float B = A - D;
 
-    float width = 32;
-    float height = 32;
+    float width = figure_width;
+    float height = figure_height;
     float margin = 0;
     bool circleShape = true;
     bool helperLines = false;
@@ -113,6 +363,120 @@ int main(int argc, char* argv[])
     int selected_figure = 0;
     int selected_pattern = 0;
 
+    if (argc > 1 && !std::strcmp(argv[1], "--soak"))
+    {
+        init_pattern();
+        return soak_phases(phases, argc > 2 ? atof(argv[2]) : 30, SIM_RATE) ? 1 : 0;
+    }
+
+    PerfCounters perf;
+    MetricsExporter metrics;
+    LatencyLog latency;
+    int loopback_frames = 0;
+    BenchOptions bench;
+    bench.parse(argc, argv);
+    GoldenRun golden;
+    golden.parse(argc, argv);
+    bool bench_scaling = false;
+    int synthetic = -1;
+    int synthetic_pixels = 0;
+    const char *layout_path = NULL;
+    const char *convert_from = NULL;
+    const char *convert_to = NULL;
+    float convert_offset_x = 0, convert_offset_y = 0;
+    LayoutExtent convert_extent = {0, 0};
+
+    for (int a = 1; a < argc; a++)
+    {
+        if (!std::strcmp(argv[a], "--perf"))
+        {
+            perf.open();
+        }
+        else if (!std::strcmp(argv[a], "--metrics"))
+        {
+            metrics.start(a + 1 < argc && atoi(argv[a + 1]) > 0 ? atoi(argv[a + 1]) : METRICS_DEFAULT_PORT);
+        }
+        else if (!std::strcmp(argv[a], "--scaling"))
+        {
+            bench_scaling = true;
+        }
+        else if (!std::strcmp(argv[a], "--synthetic") && a + 2 < argc)
+        {
+            synthetic = synthetic_kind(argv[a + 1]);
+            synthetic_pixels = atoi(argv[a + 2]);
+            if (synthetic < 0 || synthetic_pixels < 1)
+            {
+                printf("--synthetic needs one of soup, grid, strip, tree and a number of LEDs.\n");
+                return 1;
+            }
+        }
+        else if (!std::strcmp(argv[a], "--layout") && a + 1 < argc)
+        {
+            layout_path = argv[++a];
+        }
+        else if (!std::strcmp(argv[a], "--convert") && a + 2 < argc)
+        {
+            convert_from = argv[++a];
+            convert_to = argv[++a];
+        }
+        else if (!std::strcmp(argv[a], "--offset") && a + 2 < argc)
+        {
+            convert_offset_x = atof(argv[++a]);
+            convert_offset_y = atof(argv[++a]);
+        }
+        else if (!std::strcmp(argv[a], "--extent") && a + 2 < argc)
+        {
+            convert_extent.width = atof(argv[++a]);
+            convert_extent.height = atof(argv[++a]);
+        }
+        else if (!std::strcmp(argv[a], "--order") && a + 1 < argc)
+        {
+            shading_order.curve = pixel_curve(argv[++a]);
+            if (shading_order.curve < 0)
+            {
+                printf("--order needs one of wiring, morton, hilbert.\n");
+                return 1;
+            }
+        }
+        else if (!std::strcmp(argv[a], "--no-cull"))
+        {
+            culling = false;
+        }
+        else if (!std::strcmp(argv[a], "--incremental"))
+        {
+            incremental = true;
+        }
+        else if (!std::strcmp(argv[a], "--separable"))
+        {
+            separable_shading = true;
+        }
+        else if (!std::strcmp(argv[a], "--latency"))
+        {
+            latency.enabled = true;
+        }
+        else if (!std::strcmp(argv[a], "--latency-loopback"))
+        {
+            loopback_frames = a + 1 < argc && atoi(argv[a + 1]) > 0 ? atoi(argv[a + 1]) : 1000;
+        }
+        else if (!std::strcmp(argv[a], "--attribute"))
+        {
+#ifdef SHADY_PROFILE
+            attribution.calibrate();
+            attribution.enabled = true;
+#else
+            printf("--attribute needs the instrumented build (make profile), ignored.\n");
+#endif
+        }
+        else if (!std::strcmp(argv[a], "--trace") && a + 1 < argc)
+        {
+#ifdef SHADY_PROFILE
+            tracer.start(argv[a + 1], profile_now_ns());
+#else
+            printf("--trace needs the instrumented build (make profile), ignored.\n");
+#endif
+        }
+    }
+
     if (argc > 1)
     {
         if (!std::strcmp(argv[1], "2"))
@@ -125,137 +489,190 @@ int main(int argc, char* argv[])
         }
     }
 
+    // a push_back listing (this file, dergutewal.c, ...) to a layout file for --layout. the
+    // coordinates are taken as they are, --offset x y moves them (this program's figures are
+    // drawn around originOffset), every figure spans its own LEDs unless --extent w h is given
+    if (convert_from != NULL)
+    {
+        int skipped = import_listing(convert_from, figures, convert_offset_x, convert_offset_y);
+        if (skipped < 0)
+        {
+            return 1;
+        }
+        if (skipped > 0)
+        {
+            printf("skipped %i segments whose coordinates are not plain numbers.\n", skipped);
+        }
+        std::vector<LayoutExtent> extents;
+        for (int f = 0; f < figures.size(); f++)
+        {
+            extents.push_back(convert_extent.width > 0 && convert_extent.height > 0 ? convert_extent : layout_extent(figures[f]));
+        }
+        return write_layout(convert_to, figures, extents) ? 0 : 1;
+    }
+
     /// PATTERN
 
     figures.clear();
+    figures.push_back(baked_segments<Segment>(satoritree_figure1));
+    figures.push_back(baked_segments<Segment>(satoritree_figure2));
+    figures.push_back(baked_segments<Segment>(satoritree_figure3));
+
+    // a generated layout instead of the figures, for the window, --bench and --latency-loopback alike
+    if (synthetic >= 0)
+    {
+        SyntheticExtent extent = generate_layout(segments, synthetic, synthetic_pixels, distance_LED_in_cm, 1);
+        figures.clear();
+        figures.push_back(segments);
+        selected_figure = 0;
+        width = extent.width;
+        height = extent.height;
+    }
 
-    segments.clear();
-    segments.push_back(Segment(-2.3, -7, -3.5, -8.3));
-    segments.push_back(Segment(-5, -9.4, -8, -10.6));
-    segments.push_back(Segment(-9.9, -10.2, -12.4, -8));
-    segments.push_back(Segment(-12.6, -6.8, -10, -8.8));
-    segments.push_back(Segment(-7.7, -9.3, -6.2, -8.8));
-    segments.push_back(Segment(-3.6, -7, -3.6, -7));
-    segments.push_back(Segment(-5, -4.6, -8.3, -4.5));
-    segments.push_back(Segment(-10.5, -3.5, -13.7, 0.4));
-    segments.push_back(Segment(-14.1, 2.3, -13.8, 5.7));
-    segments.push_back(Segment(-12.3, 4.7, -12.6, 2.9));
-    segments.push_back(Segment(-12.2, 0.4, -10.3, -2.2));
-    segments.push_back(Segment(-7.6, -3.5, -4.2, -3.6));
-    segments.push_back(Segment(-0.8, -3, 0.8, -2.9, 1));
-    segments.push_back(Segment(0, -1.8, 0, -1.8, 1));
-    segments.push_back(Segment(-0.6, 0.9, -1.5, 14.1, 1));
-    segments.push_back(Segment(0, 15.3, 0, 15.3, 1));
-    segments.push_back(Segment(1.5, 14.1, 0.6, 0.9, 1));
-    segments.push_back(Segment(5.2, -1.9, 6.8, -1.3));
-    segments.push_back(Segment(9, 0.5, 9.8, 1.9));
-    segments.push_back(Segment(11.1, 2.3, 9.5, -0.6));
-    segments.push_back(Segment(8, -1.9, 5, -3.2));
-    segments.push_back(Segment(5.9, -5.8, 7.4, -6.5));
-    segments.push_back(Segment(9.8, -6.6, 9.8, -6.6));
-    segments.push_back(Segment(11.8, -4.4, 13.2, -1.3));
-    segments.push_back(Segment(14.4, -1, 12.2, -5.6));
-    segments.push_back(Segment(11, -7.1, 9.5, -7.8));
-    segments.push_back(Segment(7.6, -7.8, 4.7, -6.2));
-    segments.push_back(Segment(2, -7.4, 2.7, -8.9));
-    segments.push_back(Segment(4.7, -10.4, 6.4, -10.6));
-    segments.push_back(Segment(7.1, -11.7, 3.8, -11.3));
-    segments.push_back(Segment(2.4, -10.2, 0.8, -7.1));
-    segments.push_back(Segment(1.7, -4, -1.7, -4.2, 1));
-    figures.push_back(segments);
-
-    segments.clear();
-    segments.push_back(Segment(-3.1, -7.4, -3.8, -8.9));
-    segments.push_back(Segment(-5.3, -10, -8.8, -10.2));
-    segments.push_back(Segment(-10.5, -9.5, -12.7, -7));
-    segments.push_back(Segment(-11.1, -7, -9.8, -8));
-    segments.push_back(Segment(-7.8, -8.2, -6.2, -7.8));
-    segments.push_back(Segment(-4.2, -7, -4.2, -7));
-    segments.push_back(Segment(-4.6, -3, -7.9, -3));
-    segments.push_back(Segment(-9.9, -2.3, -12.7, -0.5));
-    segments.push_back(Segment(-13.6, 1.1, -14, 6));
-    segments.push_back(Segment(-12.8, 4.9, -11.4, 1.9));
-    segments.push_back(Segment(-10, 0.5, -8.6, -0.3));
-    segments.push_back(Segment(-7, -1.7, -5.4, -1.8));
-    segments.push_back(Segment(-0.8, -2.9, 0.8, -2.9, 2));
-    segments.push_back(Segment(0, -1.8, 0, -1.8, 2));
-    segments.push_back(Segment(-0.8, 0.7, -1.6, 13.9, 2));
-    segments.push_back(Segment(0, 15.5, 0, 15.5, 2));
-    segments.push_back(Segment(1.6, 13.9, 0.8, 0.7, 2));
-    segments.push_back(Segment(5.2, -1.8, 6.4, -0.7));
-    segments.push_back(Segment(7.7, 0.7, 8.5, 2.1));
-    segments.push_back(Segment(10.1, 3.2, 9.2, 0));
-    segments.push_back(Segment(8, -1.6, 5.2, -3.2));
-    segments.push_back(Segment(1.7, -4, -1.7, -4.1, 2));
-    segments.push_back(Segment(4.4, -6, 6, -6.5));
-    segments.push_back(Segment(8, -6.7, 8, -6.7));
-    segments.push_back(Segment(9.8, -6, 12.6, -4.3));
-    segments.push_back(Segment(14.4, -4, 11.1, -7.8));
-    segments.push_back(Segment(9.5, -8.8, 7.9, -9));
-    segments.push_back(Segment(6, -8.6, 3.2, -6.8));
-    segments.push_back(Segment(0.8, -8.3, 1.3, -10));
-    segments.push_back(Segment(2.1, -11.7, 3.1, -13));
-    segments.push_back(Segment(2.8, -14.4, 0.4, -12.2));
-    segments.push_back(Segment(-0.3, -10.4, -0.4, -7.1));
-    figures.push_back(segments);
-
-    segments.clear();
-    segments.push_back(Segment(1.3, -7.5, 1.6, -10.8));
-    segments.push_back(Segment(0.8, -12.7, -2, -14.5));
-    segments.push_back(Segment(-1.8, -12.9, -0.7, -11.8));
-    segments.push_back(Segment(0.1, -10.1, 0.2, -8.4));
-    segments.push_back(Segment(-2.8, -7.6, -4, -8.9));
-    segments.push_back(Segment(-5.7, -9.6, -8.9, -9.3));
-    segments.push_back(Segment(-10.8, -8.6, -13.3, -6.6));
-    segments.push_back(Segment(-13.1, -5.6, -10.1, -6.9));
-    segments.push_back(Segment(-8, -7.5, -6.3, -7.7));
-    segments.push_back(Segment(-4.4, -7.3, -4.4, -7.3));
-    segments.push_back(Segment(-4.6, -4.1, -8.8, -3.4));
-    segments.push_back(Segment(-9.5, -2.6, -13.2, 0.9));
-    segments.push_back(Segment(-14.1, 2.6, -14.1, 6));
-    segments.push_back(Segment(-12.8, 4.9, -12.4, 3.3));
-    segments.push_back(Segment(-11.4, 1.7, -9, -0.6));
-    segments.push_back(Segment(-7.2, -1.7, -5.6, -2.5));
-    segments.push_back(Segment(-1, -3.2, 0.8, -3.1, 3));
-    segments.push_back(Segment(0, -2, 0, -2, 3));
-    segments.push_back(Segment(-0.7, 0.4, -1.6, 13.8, 3));
-    segments.push_back(Segment(0, 15.5, 0, 15.5, 3));
-    segments.push_back(Segment(1.4, 13.8, 0.6, 0.5, 3));
-    segments.push_back(Segment(4.8, -2.4, 6.3, -1.9));
-    segments.push_back(Segment(8, -0.8, 9.2, 0.4));
-    segments.push_back(Segment(11, 1, 9.3, -1.8));
-    segments.push_back(Segment(7.8, -3, 4.5, -3.5));
-    segments.push_back(Segment(1.7, -4.2, -1.7, -4.2, 3));
-    segments.push_back(Segment(6, -6.7, 7.6, -7.3));
-    segments.push_back(Segment(9.7, -7.5, 9.7, -7.5));
-    segments.push_back(Segment(11.4, -6.7, 13.3, -4));
-    segments.push_back(Segment(14.8, -3.6, 12.8, -8));
-    segments.push_back(Segment(10.8, -9.3, 9.2, -9.4));
-    segments.push_back(Segment(7.3, -9, 4.5, -7.2));
-    figures.push_back(segments);
+    // the figures of a layout file instead of the ones compiled in. a file that does not exist
+    // yet is where RETURN will write the figures to
+    LayoutFile layout;
+    bool layout_loaded = false;
+    LayoutExtent extent = {width, height};
+    std::vector<LayoutExtent> extents(figures.size(), extent);
+    if (layout_path != NULL && synthetic < 0 && access(layout_path, F_OK) == 0)
+    {
+        if (!layout.open(layout_path))
+        {
+            return 1;
+        }
+        if (layout.figures() == 0)
+        {
+            printf("layout %s has no figures.\n", layout_path);
+            return 1;
+        }
+        figures.resize(layout.figures());
+        extents.resize(layout.figures());
+        for (int f = 0; f < figures.size(); f++)
+        {
+            layout.read_segments(f, figures[f]);
+            extents[f] = layout.get_extent(f);
+        }
+        selected_figure = min(selected_figure, (int)figures.size() - 1);
+        width = extents[selected_figure].width;
+        height = extents[selected_figure].height;
+        layout_loaded = true;
+        mapped_layout = &layout;
+    }
+    else if (layout_path != NULL && synthetic < 0)
+    {
+        printf("%s does not exist yet, RETURN writes the figures to it.\n", layout_path);
+    }
 
     segments = figures[selected_figure];
 
+    // the figures as compiled in or loaded, shaded from the baked tables in a BAKED_LAYOUT build
+    // or from the LEDs of the mapped layout file until edited
+    bool figures_stored = synthetic < 0;
+    int stored_figure = figures_stored ? selected_figure : -1;
+
+    SpatialGrid segment_index(segment_index_cell);
+    std::vector<int> selection, edit_targets, candidates, segment_first;
+    int hovered_segment = -1;
+    for (int s = 0; s < segments.size(); s++)
+    {
+        index_segment(segment_index, segments[s], s);
+    }
+
     /// END PATTERN
 
     P.clear();
-    for (std::vector<Segment>::iterator iseg = segments.begin(); iseg != segments.end(); ++iseg)
+    if (layout_loaded)
     {
-        int segcount = iseg - segments.begin();
-        for (int p = 0; p < iseg->pixels; p++)
+        layout.read_pixels(selected_figure, P);
+    }
+    else
+    {
+        for (std::vector<Segment>::iterator iseg = segments.begin(); iseg != segments.end(); ++iseg)
         {
-            Pixel pixel = Pixel(iseg->get_pixel(p), segcount);
-            P.push_back(pixel);
+            int segcount = iseg - segments.begin();
+            for (int p = 0; p < iseg->pixels; p++)
+            {
+                Pixel pixel = Pixel(iseg->get_pixel(p), segcount);
+                P.push_back(pixel);
+            }
         }
     }
     float meters_required = numpix * distance_LED_in_m;
     printf("Pixels: %i\nMeters: %g\nWidth: %g\nHeight: %g\n", numpix, meters_required, width, height);
 
-    const float SCALE = N * .3;
+    // the frames of every pattern on every figure, from a fixed seed
+    if (golden.enabled())
+    {
+        char name[64];
+        for (int f = 0; f < figures.size(); f++)
+        {
+            invalidate_layout();
+            for (int pattern = 0; pattern < nr_of_patterns; pattern++)
+            {
+                snprintf(name, sizeof(name), "satoritree/figure%i/pattern%i", f + 1, pattern);
+                srandom(GOLDEN_SEED);
+                init_pattern();
+                for (long frame = 0; frame < golden.frames; frame++)
+                {
+                    // in between the steps like in the window, a quarter to all the way to the last one
+                    proceed_pattern(frame + 1);
+                    interpolate_pattern((frame % 4 + 1) / 4.);
+                    shade_figure(P, figures[f], figures_stored ? f : -1, pattern, frame + 1, extents[f].width, extents[f].height, 0);
+                    golden.add(name, frame, P);
+                }
+            }
+        }
+        return golden.finish();
+    }
+
+    // every pattern on every figure, with the pattern stepped once per frame
+    if (bench.frames > 0)
+    {
+        BenchSuite suite;
+        char name[64];
+        for (int f = 0; f < figures.size(); f++)
+        {
+            invalidate_layout();
+            for (int pattern = 0; pattern < nr_of_patterns; pattern++)
+            {
+                snprintf(name, sizeof(name), "satoritree/figure%i/pattern%i", f + 1, pattern);
+                if (!bench.wanted(name))
+                {
+                    continue;
+                }
+                BenchTimer timer;
+                init_pattern();
+                for (long frame = 0; frame < BENCH_WARMUP_FRAMES + bench.frames; frame++)
+                {
+                    if (frame == BENCH_WARMUP_FRAMES)
+                    {
+                        timer = BenchTimer();
+                    }
+                    proceed_pattern(frame + 1);
+                    interpolate_pattern(1);
+                    shade_figure(P, figures[f], figures_stored ? f : -1, pattern, frame + 1, extents[f].width, extents[f].height, 0);
+                }
+                suite.add_frames(name, timer, bench.frames, numpix);
+            }
+        }
+        if (bench_scaling)
+        {
+            bench_scale(suite, bench);
+        }
+        return bench.finish(suite, argv[0]);
+    }
+
+    if (loopback_frames > 0)
+    {
+        return latency_loopback(loopback_frames, 3 * numpix) ? 1 : 0;
+    }
+
+    const float SCALE = min(N * .3f, 900.f / max(width, height));
     const float MARGIN = margin * SCALE;
     const float WIDTH = width * SCALE;
     const float HEIGHT = height * SCALE;
-    const float LEDSIZE = .125 * N;
+    const float LEDSIZE = SCALE * .125 / .3;
 
     if (SDL_Init(SDL_INIT_VIDEO))
     {
@@ -271,7 +688,7 @@ int main(int argc, char* argv[])
         return 2;
     }
 
-    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC | SDL_RENDERER_TARGETTEXTURE);
     if (renderer == NULL)
     {
         SDL_DestroyWindow(window);
@@ -280,290 +697,617 @@ int main(int argc, char* argv[])
         return 3;
     }
 
+    PreviewCache preview;
+    if (!preview.create(renderer, WIDTH, HEIGHT))
+    {
+        printf ("SDL_CreateTexture Error: %s", SDL_GetError());
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 4;
+    }
+
+    Viewport view = Viewport(SCALE, WIDTH, HEIGHT);
+    SplatBuffer splats;
+    OutlineBatch strip_outlines, selected_outline;
+    splats.resize(WIDTH, HEIGHT);
+
     SDL_Rect margin_t, margin_b, margin_l, margin_r;
-    margin_t.x = 0;
-    margin_t.y = 0;
-    margin_b.x = 0;
-    margin_b.y = HEIGHT - MARGIN;
-    margin_l.x = 0;
-    margin_l.y = 0;
-    margin_r.x = WIDTH - MARGIN;
-    margin_r.y = 0;
-    margin_t.w = margin_b.w = WIDTH;
-    margin_t.h = margin_b.h = MARGIN;
-    margin_l.w = margin_r.w = MARGIN;
-    margin_l.h = margin_r.h = HEIGHT;
 
     float new_origin_x, new_origin_y, new_to_x, new_to_y;
 
     int quit = 0;
-    long time = 0;
+    SimClock clock;
     bool firstClick = true;
 
+    // the events of a frame are decoded into commands first and applied right after, both
+    // on this thread since SDL only pumps events on the thread that created the window
+    std::vector<EditorCommand> commands;
+    commands.reserve(256);
+    EditorCommand command;
+
     init_pattern();
 
+#ifdef SHADY_PROFILE
+    ProfileStats profile_stats;
+    bool showHud = false;
+    long frames = 0;
+#endif
+
+    double show_start = SimClock::now();
+    double frame_start = show_start;
+
+    // --alloc-check without --bench: after the warm-up frames the loop must not touch the heap
+    long checked_frames = 0;
+    int allocating_frames = 0;
+    long long frame_allocations = bench_allocations.load();
+
     while (!quit)
     {
-        if (SDL_PollEvent(&e))
+        PROFILE_BEGIN(STAGE_FRAME);
+        TRACE_FRAME_BEGIN();
+
+        //////////// INPUT ////////////
+        PROFILE_BEGIN(STAGE_INPUT);
+        while (SDL_PollEvent(&e))
         {
             switch (e.type)
             {
-                case SDL_MOUSEBUTTONDOWN:
+                case SDL_MOUSEMOTION:
+                    if (e.motion.state & (SDL_BUTTON_RMASK | SDL_BUTTON_MMASK))
+                    {
+                        view.pan(e.motion.xrel, e.motion.yrel);
+                        preview.dirty = true;
+                    }
+                    else
+                    {
+                        int hovered = pick_segment(segment_index, segments, view.to_world(e.motion.x, e.motion.y), candidates);
+                        if (hovered != hovered_segment)
+                        {
+                            hovered_segment = hovered;
+                            preview.dirty = true;
+                        }
+                    }
+                    break;
+
+                case SDL_MOUSEWHEEL:
+                {
                     int x, y;
                     SDL_GetMouseState(&x, &y);
+                    view.zoom_at(x, y, pow(ZOOM_STEP, e.wheel.y));
+                    preview.dirty = true;
+                    break;
+                }
+
+                default:
+                    if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_HOME)
+                    {
+                        view.reset();
+                        preview.dirty = true;
+                    }
+#ifdef SHADY_PROFILE
+                    else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F1)
+                    {
+                        showHud = !showHud;
+                    }
+#endif
+                    else if (decode_event(e, view, command))
+                    {
+                        commands.push_back(command);
+                    }
+                    break;
+            }
+        }
+
+        PROFILE_END(STAGE_INPUT);
+
+        //////////// EDITOR ////////////
+        PROFILE_BEGIN(STAGE_EDITOR);
+        if (metrics.running)
+        {
+            metrics.queue_depth.store(commands.size(), std::memory_order_relaxed);
+        }
+        for (int c = 0; c < commands.size(); c++)
+        {
+            command = commands[c];
+            preview.dirty = true;
+            if (command.edits_layout())
+            {
+                stored_figure = -1;
+                invalidate_layout();
+            }
+            switch (command.type)
+            {
+                case CMD_CLICK:
                     if (firstClick)
                     {
-                        new_origin_x = x / SCALE;
-                        new_origin_y = y / SCALE;
+                        new_origin_x = command.x;
+                        new_origin_y = command.y;
                         printf("(%g, %g, ...\n", new_origin_x, new_origin_y);
                         firstClick = false;
                     }
                     else
                     {
-                        new_to_x = x / SCALE;
-                        new_to_y = y / SCALE;
+                        new_to_x = command.x;
+                        new_to_y = command.y;
                         Segment new_seg = Segment(new_origin_x, new_origin_y, new_to_x, new_to_y);
                         segments.push_back(new_seg);
                         for (int p = 0; p < new_seg.pixels; p++)
                         {
                             P.push_back(Pixel(new_seg.get_pixel(p), segments.size() - 1));
                         }
+                        index_segment(segment_index, segments.back(), segments.size() - 1);
                         meters_required = numpix * distance_LED_in_m;
                         printf("(%g, %g, %g, %g) Pixels: %i, Meters: %g\n", new_origin_x, new_origin_y, new_to_x, new_to_y, numpix, meters_required);
                         firstClick = true;
                     }
                     break;
 
-                case SDL_KEYDOWN:
+                case CMD_REMOVE_LAST:
+                {
+                    if (segments.empty())
+                    {
+                        break;
+                    }
+                    Segment last_seg = segments.back();
+                    segments.pop_back();
+                    segment_index.remove(segments.size());
+                    selection.clear();
+                    hovered_segment = -1;
+                    for (int p = 0; p < last_seg.pixels; p++)
+                    {
+                        P.pop_back();
+                    }
+                    selected_segment = min(selected_segment, max((int)segments.size() - 1, 0));
+                    break;
+                }
+                case CMD_CLEAR:
+                    segments.clear();
+                    P.clear();
+                    segment_index.clear();
+                    selection.clear();
+                    hovered_segment = -1;
+                    selected_segment = 0;
+                    printf("erased everything.\n");
+                    break;
+
+                case CMD_EXPORT:
+                    figures[selected_figure] = segments;
+                    write_layout(layout_path != NULL ? layout_path : default_layout_path, figures, extents);
+                    break;
+                case CMD_NEXT_PATTERN:
+                    selected_pattern = (selected_pattern + 1) % nr_of_patterns;
+                    break;
+                case CMD_QUIT:
+                    quit = 1;
+                    break;
 
-                    switch (e.key.keysym.sym)
+                default:
+                    if (segments.empty())
                     {
-                        case SDLK_BACKSPACE:
-                        {
-                            Segment last_seg = segments.back();
-                            segments.pop_back();
-                            for (int p = 0; p < last_seg.pixels; p++)
+                        break;
+                    }
+                    edit_targets = selection;
+                    if (edit_targets.empty())
+                    {
+                        edit_targets.push_back(selected_segment);
+                    }
+                    switch (command.type)
+                    {
+                        case CMD_MOVE:
+                        case CMD_TURN:
+                        case CMD_CHANGE_LENGTH:
+                        case CMD_FLIP:
+                            for (std::vector<int>::iterator it = edit_targets.begin(); it != edit_targets.end(); ++it)
                             {
-                                P.pop_back();
+                                switch (command.type)
+                                {
+                                    case CMD_MOVE:
+                                        segments[*it].move_horizontally(command.x);
+                                        segments[*it].move_vertically(command.y);
+                                        break;
+                                    case CMD_TURN:
+                                        segments[*it].turn(command.x);
+                                        break;
+                                    case CMD_CHANGE_LENGTH:
+                                        segments[*it].change_length(command.n);
+                                        break;
+                                    case CMD_FLIP:
+                                        segments[*it].flip();
+                                        break;
+                                }
+                                index_segment(segment_index, segments[*it], *it);
                             }
                             break;
-                        }
-                        case SDLK_SPACE:
-                            segments.clear();
-                            P.clear();
-                            printf("erased everything.\n");
-                            break;
-                        /*
-                        case SDLK_LEFT:
-                            P.pop_back();
-                            break;
-                        */
-
-                        case SDLK_w:
-                            segments[selected_segment].move_vertically(-0.1);
-                            break;
-                        case SDLK_s:
-                            segments[selected_segment].move_vertically(+0.1);
-                            break;
-                        case SDLK_d:
-                            segments[selected_segment].move_horizontally(+0.1);
-                            break;
-                        case SDLK_a:
-                            segments[selected_segment].move_horizontally(-0.1);
-                            break;
-                        case SDLK_e:
-                            segments[selected_segment].turn(-1);
-                            break;
-                        case SDLK_q:
-                            segments[selected_segment].turn(+1);
-                            break;
-                        case SDLK_r:
-                            segments[selected_segment].change_length(1);
+                        case CMD_SWAP_NEXT:
+                        {
+                            int partner = selected_segment == segments.size() - 1 ? 0 : selected_segment + 1;
+                            std::swap(segments[selected_segment], segments[partner]);
+                            index_segment(segment_index, segments[selected_segment], selected_segment);
+                            index_segment(segment_index, segments[partner], partner);
+                            selected_segment = partner;
+                            selection.clear();
+                            print_all_segments(segments);
                             break;
-                        case SDLK_f:
-                            segments[selected_segment].change_length(-1);
+                        }
+                        case CMD_SWAP_PREVIOUS:
+                        {
+                            int partner = selected_segment == 0 ? segments.size() - 1 : selected_segment - 1;
+                            std::swap(segments[selected_segment], segments[partner]);
+                            index_segment(segment_index, segments[selected_segment], selected_segment);
+                            index_segment(segment_index, segments[partner], partner);
+                            selected_segment = partner;
+                            selection.clear();
+                            print_all_segments(segments);
                             break;
-                        case SDLK_t:
-                            segments[selected_segment].flip();
+                        }
+                        case CMD_SELECT:
+                            selected_segment = (selected_segment + command.n + segments.size()) % segments.size();
+                            selection.clear();
+                            print_segment_info(segments, selected_segment, width, height);
                             break;
-                        case SDLK_x:
-                            if (selected_segment == segments.size() - 1)
-                            {
-                                std::swap(segments.front(), segments.back());
-                                selected_segment = 0;
-                            }
-                            else
+                        case CMD_SELECT_AT:
+                        {
+                            int picked = pick_segment(segment_index, segments, vec2(command.x, command.y), candidates);
+                            selection.clear();
+                            if (picked >= 0)
                             {
-                                std::swap(segments[selected_segment], segments[selected_segment + 1]);
-                                selected_segment++;
+                                selected_segment = picked;
+                                selection.push_back(picked);
+                                print_segment_info(segments, selected_segment, width, height);
                             }
-                            print_all_segments(segments);
                             break;
-                        case SDLK_y:
-                            if (selected_segment == 0)
+                        }
+                        case CMD_SELECT_BOX:
+                        {
+                            float x_min = min(command.x, command.x2);
+                            float x_max = max(command.x, command.x2);
+                            float y_min = min(command.y, command.y2);
+                            float y_max = max(command.y, command.y2);
+                            segment_index.query_box(x_min, y_min, x_max, y_max, candidates);
+                            std::sort(candidates.begin(), candidates.end());
+                            selection.clear();
+                            for (std::vector<int>::iterator it = candidates.begin(); it != candidates.end(); ++it)
                             {
-                                std::swap(segments.front(), segments.back());
-                                selected_segment = segments.size() - 1;
+                                for (int p = 0; p < segments[*it].pixels; p++)
+                                {
+                                    vec2 pixel = segments[*it].get_pixel(p);
+                                    if (pixel.x >= x_min && pixel.x <= x_max && pixel.y >= y_min && pixel.y <= y_max)
+                                    {
+                                        selection.push_back(*it);
+                                        break;
+                                    }
+                                }
                             }
-                            else
+                            if (!selection.empty())
                             {
-                                std::swap(segments[selected_segment], segments[selected_segment - 1]);
-                                selected_segment--;
+                                selected_segment = selection[0];
                             }
-                            print_all_segments(segments);
-                            break;
-
-                        case SDLK_UP:
-                            selected_segment = (selected_segment + 1) % segments.size();
-                            printf("selected segment %i \t %i pixels \t\t (%.2f, %.2f)  (%.2f, %.2f) \t\t ANTI [ (%.2f, %.2f)  (%.2f, %.2f) ] \n", selected_segment, segments[selected_segment].pixels,
-                                                                segments[selected_segment].origin_x - originOffsetX, segments[selected_segment].origin_y - originOffsetY,
-                                                                segments[selected_segment].get_last_pixel_plus_one().x - originOffsetX, segments[selected_segment].get_last_pixel_plus_one().y - originOffsetY,
-                                                                width - segments[selected_segment].origin_x - originOffsetX, height - segments[selected_segment].origin_y - originOffsetY,
-                                                                width - segments[selected_segment].get_last_pixel_plus_one().x - originOffsetX, height - segments[selected_segment].get_last_pixel_plus_one().y - originOffsetY);
-                            break;
-                        case SDLK_DOWN:
-                            selected_segment = (selected_segment - 1 + segments.size()) % segments.size();
-                            printf("selected segment %i \t %i pixels \t\t (%.2f, %.2f)  (%.2f, %.2f) \t\t ANTI [ (%.2f, %.2f)  (%.2f, %.2f) ] \n", selected_segment, segments[selected_segment].pixels,
-                                                                segments[selected_segment].origin_x - originOffsetX, segments[selected_segment].origin_y - originOffsetY,
-                                                                segments[selected_segment].get_last_pixel_plus_one().x - originOffsetX, segments[selected_segment].get_last_pixel_plus_one().y - originOffsetY,
-                                                                width - segments[selected_segment].origin_x - originOffsetX, height - segments[selected_segment].origin_y - originOffsetY,
-                                                                width - segments[selected_segment].get_last_pixel_plus_one().x - originOffsetX, height - segments[selected_segment].get_last_pixel_plus_one().y - originOffsetY);
-                            break;
-
-                        case SDLK_ESCAPE:
-                            quit = 1;
+                            printf("selected %i segments\n", (int)selection.size());
                             break;
-
-                        case SDLK_RETURN:
-                            print_all_segments(segments);
-                            break;
-
-                        case SDLK_TAB:
-                            selected_pattern = (selected_pattern + 1) % nr_of_patterns;
+                        }
                     }
                     break;
-
-                case SDL_QUIT:
-                    quit = 1;
-                    break;
             }
         }
 
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-        SDL_RenderClear(renderer);
-
-        //////////// MARGIN /////////////
-
-        SDL_SetRenderDrawColor(renderer, 20, 20, 20, 255);
-        SDL_RenderFillRect(renderer, &margin_t);
-        SDL_RenderFillRect(renderer, &margin_b);
-        SDL_RenderFillRect(renderer, &margin_l);
-        SDL_RenderFillRect(renderer, &margin_r);
-
-        ///////////// OUTLINE ///////////
-
-        if (circleShape)
-        {
-            filledCircleColor(renderer, .5 * WIDTH, .5 * HEIGHT, .5 * WIDTH, RGB(255, 0, 0) );
-            filledCircleColor(renderer, .5 * WIDTH, .5 * HEIGHT, .5 * WIDTH - 2, RGB(0, 0, 0) );
-        }
-        if (helperLines)
-        {
-            filledCircleColor(renderer, .5 * WIDTH, .5 * HEIGHT, .25 * WIDTH, RGB(255, 0, 0) );
-            filledCircleColor(renderer, .5 * WIDTH, .5 * HEIGHT, .25 * WIDTH - 2, RGB(0, 0, 0) );
-            SDL_SetRenderDrawColor(renderer, 250, 0, 0, 255);
-            SDL_RenderDrawLine(renderer, .25 * WIDTH, 0, .25 * WIDTH, HEIGHT);
-            SDL_RenderDrawLine(renderer, .50 * WIDTH, 0, .50 * WIDTH, HEIGHT);
-            SDL_RenderDrawLine(renderer, .75 * WIDTH, 0, .75 * WIDTH, HEIGHT);
-            SDL_RenderDrawLine(renderer, 0, .25 * HEIGHT, WIDTH, .25 * HEIGHT);
-            SDL_RenderDrawLine(renderer, 0, .50 * HEIGHT, WIDTH, .50 * HEIGHT);
-            SDL_RenderDrawLine(renderer, 0, .75 * HEIGHT, WIDTH, .75 * HEIGHT);
-        }
+        commands.clear();
+        PROFILE_END(STAGE_EDITOR);
 
-        //////////// PATTERN ////////////
-        P.clear();
-        for (std::vector<Segment>::iterator iseg = segments.begin(); iseg != segments.end(); ++iseg)
+        if (preview.dirty)
         {
-            int segcount = iseg - segments.begin();
-            for (int p = 0; p < iseg->pixels; p++)
+            PROFILE_BEGIN(STAGE_BACKGROUND);
+            SDL_SetRenderTarget(renderer, preview.background);
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+            SDL_RenderClear(renderer);
+
+            //////////// MARGIN /////////////
+
+            margin_t.x = margin_b.x = margin_l.x = view.to_screen_x(0);
+            margin_t.y = margin_l.y = margin_r.y = view.to_screen_y(0);
+            margin_b.y = view.to_screen_y(height - margin);
+            margin_r.x = view.to_screen_x(width - margin);
+            margin_t.w = margin_b.w = width * view.scale();
+            margin_t.h = margin_b.h = margin * view.scale();
+            margin_l.w = margin_r.w = margin * view.scale();
+            margin_l.h = margin_r.h = height * view.scale();
+
+            SDL_SetRenderDrawColor(renderer, 20, 20, 20, 255);
+            SDL_RenderFillRect(renderer, &margin_t);
+            SDL_RenderFillRect(renderer, &margin_b);
+            SDL_RenderFillRect(renderer, &margin_l);
+            SDL_RenderFillRect(renderer, &margin_r);
+
+            ///////////// OUTLINE ///////////
+
+            float view_left = view.to_screen_x(0);
+            float view_top = view.to_screen_y(0);
+            float view_width = width * view.scale();
+            float view_height = height * view.scale();
+
+            if (circleShape)
             {
-                Pixel pixel = Pixel(iseg->get_pixel(p), segcount);
-                vec2 relative_coord = vec2(pixel.x/width, pixel.y/height);
-                pixel.L = shader(selected_pattern, time, relative_coord, numpix, segcount - selected_segment, iseg->type);
-                P.push_back(pixel);
+                filledCircleColor(renderer, view_left + .5 * view_width, view_top + .5 * view_height, .5 * view_width, RGB(255, 0, 0) );
+                filledCircleColor(renderer, view_left + .5 * view_width, view_top + .5 * view_height, .5 * view_width - 2, RGB(0, 0, 0) );
             }
-        }
-
-        //////////// LIGHTS ////////////
-        for(int p = 0; p < numpix; p++)
-        {
-            if(numpix < 1000 && blurLights)
+            if (helperLines)
             {
-                for (int i=0; i<4; i++)
-                {
-                    float step = 1 + .25 * i;
-                    float intensity = pow(.5, i);
-                    filledCircleColor(renderer, SCALE * P[p].x, SCALE * P[p].y, LEDSIZE * step, LEDColor(P[p].L, intensity));
-                }
+                filledCircleColor(renderer, view_left + .5 * view_width, view_top + .5 * view_height, .25 * view_width, RGB(255, 0, 0) );
+                filledCircleColor(renderer, view_left + .5 * view_width, view_top + .5 * view_height, .25 * view_width - 2, RGB(0, 0, 0) );
+                SDL_SetRenderDrawColor(renderer, 250, 0, 0, 255);
+                SDL_RenderDrawLine(renderer, view_left + .25 * view_width, view_top, view_left + .25 * view_width, view_top + view_height);
+                SDL_RenderDrawLine(renderer, view_left + .50 * view_width, view_top, view_left + .50 * view_width, view_top + view_height);
+                SDL_RenderDrawLine(renderer, view_left + .75 * view_width, view_top, view_left + .75 * view_width, view_top + view_height);
+                SDL_RenderDrawLine(renderer, view_left, view_top + .25 * view_height, view_left + view_width, view_top + .25 * view_height);
+                SDL_RenderDrawLine(renderer, view_left, view_top + .50 * view_height, view_left + view_width, view_top + .50 * view_height);
+                SDL_RenderDrawLine(renderer, view_left, view_top + .75 * view_height, view_left + view_width, view_top + .75 * view_height);
             }
-        }
 
-        //////// STRIP RECTANGLE //////////
+            PROFILE_END(STAGE_BACKGROUND);
 
-        if (drawStripRectangle)
-        {
-            float L2 = .5 * distance_LED_in_cm;
-            float H2 = .5 * stripWidth;
-            for (std::vector<Segment>::iterator iseg = segments.begin(); iseg != segments.end(); ++iseg)
+            //////// STRIP RECTANGLE //////////
+
+            PROFILE_SCOPE(STAGE_STRIPS);
+            SDL_SetRenderTarget(renderer, preview.overlay);
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+            SDL_RenderClear(renderer);
+
+            // the selection and the segment under the mouse are outlined always, the other
+            // segments only with drawStripRectangle
+            strip_outlines.clear();
+            selected_outline.clear();
+            for (std::vector<Segment>::iterator iseg = segments.begin(); iseg != segments.end(); ++iseg)
             {
-                if (iseg - segments.begin() == selected_segment)
+                int s = iseg - segments.begin();
+                bool selected = s == selected_segment || std::find(selection.begin(), selection.end(), s) != selection.end();
+                if (!selected && s != hovered_segment && !drawStripRectangle)
+                {
+                    continue;
+                }
+                vec2 *corners = iseg->get_outline(stripWidth);
+                vec2 screen_corners[4];
+                for (int c = 0; c < 4; c++)
+                {
+                    screen_corners[c] = view.to_screen(corners[c]);
+                }
+                if (!view.is_visible_box(min(min(screen_corners[0].x, screen_corners[1].x), min(screen_corners[2].x, screen_corners[3].x)) - 1,
+                                         min(min(screen_corners[0].y, screen_corners[1].y), min(screen_corners[2].y, screen_corners[3].y)) - 1,
+                                         max(max(screen_corners[0].x, screen_corners[1].x), max(screen_corners[2].x, screen_corners[3].x)) + 1,
+                                         max(max(screen_corners[0].y, screen_corners[1].y), max(screen_corners[2].y, screen_corners[3].y)) + 1))
+                {
+                    continue;
+                }
+                if (selected)
+                {
+                    selected_outline.add_outline(screen_corners, 200, 200, 200, 255);
+                }
+                else if (s == hovered_segment)
                 {
-                    SDL_SetRenderDrawColor(renderer, 200, 200, 200, 255);
+                    selected_outline.add_outline(screen_corners, 120, 120, 255, 255);
                 }
                 else
                 {
-                    SDL_SetRenderDrawColor(renderer, 0, 0, 200, 128);
+                    strip_outlines.add_outline(screen_corners, 0, 0, 200, 128);
                 }
+            }
+            strip_outlines.draw(renderer);
+            selected_outline.draw(renderer);
+        }
+
+        //////////// PATTERN ////////////
+        PROFILE_BEGIN(STAGE_PROCEED);
+        FrameStamp stamp;
+        stamp.mark(STAMP_SAMPLED);
+        int steps = clock.advance(stamp.at[STAMP_SAMPLED]);
+        for (int step = 0; step < steps; step++)
+        {
+            proceed_pattern(clock.ticks - steps + step + 1);
+        }
+        interpolate_pattern(clock.alpha());
+        float time = clock.time();
+        PROFILE_END(STAGE_PROCEED);
+
+        // the steps the clock threw away after a stall were missed as well
+        if (steps + clock.skipped > 1 && metrics.running)
+        {
+            metrics.frames_dropped.fetch_add(steps + clock.skipped - 1, std::memory_order_relaxed);
+        }
 
-                float ca = cos(iseg->direction * PI / 180.);
-                float sa = sin(iseg->direction * PI / 180.);
-                float corner1x = iseg->origin_x - ca * L2 + sa * H2;
-                float corner1y = iseg->origin_y + sa * L2 + ca * H2;
-                float corner2x = iseg->origin_x - ca * L2 - sa * H2;
-                float corner2y = iseg->origin_y + sa * L2 - ca * H2;
-                float corner4x = iseg->get_last_pixel().x + ca * L2 + sa * H2;
-                float corner4y = iseg->get_last_pixel().y - sa * L2 + ca * H2;
-                float corner3x = iseg->get_last_pixel().x + ca * L2 - sa * H2;
-                float corner3y = iseg->get_last_pixel().y - sa * L2 - ca * H2;
-                SDL_RenderDrawLine(renderer, SCALE * corner1x, SCALE * corner1y - 1, SCALE * corner2x, SCALE * corner2y - 1);
-                SDL_RenderDrawLine(renderer, SCALE * corner2x, SCALE * corner2y - 1, SCALE * corner3x, SCALE * corner3y - 1);
-                SDL_RenderDrawLine(renderer, SCALE * corner3x, SCALE * corner3y - 1, SCALE * corner4x, SCALE * corner4y - 1);
-                SDL_RenderDrawLine(renderer, SCALE * corner4x, SCALE * corner4y - 1, SCALE * corner1x, SCALE * corner1y - 1);
-                //SDL_RenderDrawLine(renderer, SCALE * corner1x + 1, SCALE * corner1y, SCALE * corner2x + 1, SCALE * corner2y);
-                SDL_RenderDrawLine(renderer, SCALE * corner2x + 1, SCALE * corner2y, SCALE * corner3x + 1, SCALE * corner3y);
-                SDL_RenderDrawLine(renderer, SCALE * corner3x + 1, SCALE * corner3y, SCALE * corner4x + 1, SCALE * corner4y);
-                SDL_RenderDrawLine(renderer, SCALE * corner4x + 1, SCALE * corner4y, SCALE * corner1x + 1, SCALE * corner1y);
-                SDL_RenderDrawLine(renderer, SCALE * corner3x - 1, SCALE * corner3y + 1, SCALE * corner4x - 1, SCALE * corner4y);
+        PROFILE_BEGIN(STAGE_SHADE);
+        double shade_start = metrics.running ? SimClock::now() : 0;
+        if (perf.enabled)
+        {
+            perf.begin();
+        }
+        shade_figure(P, segments, stored_figure, selected_pattern, time, width, height, selected_segment);
+
+        if (perf.enabled)
+        {
+            perf.end(selected_pattern, numpix);
+        }
+        if (metrics.running)
+        {
+            metrics.shade_ns_per_pixel.set(numpix > 0 ? 1e9 * (SimClock::now() - shade_start) / numpix : 0);
+            if (metrics.frames++ % METRICS_CURRENT_EVERY == 0)
+            {
+                metrics.current_amps.set(estimate_current(P));
             }
+            metrics.pixels.store(numpix, std::memory_order_relaxed);
         }
+        PROFILE_END(STAGE_SHADE);
+        stamp.mark(STAMP_SHADED);
 
+        //////////// LIGHTS ////////////
+        PROFILE_BEGIN(STAGE_LIGHTS);
+        float ledsize = LEDSIZE * view.zoom;
+        bool splatMode = ledsize < 1;
+        bool glowLights = numpix < 1000 && blurLights;
+        float glowRadius = 1.75 * ledsize + 1;
+
+        SDL_SetRenderTarget(renderer, preview.lights);
+        if (preview.collect_changes(P, incremental ? &shade_cache.dirty : NULL) || splatMode)
+        {
+            SDL_RenderCopy(renderer, preview.background, NULL, NULL);
+            for(int p = 0; p < numpix; p++)
+            {
+                float sx = view.to_screen_x(P[p].x);
+                float sy = view.to_screen_y(P[p].y);
+                preview.drawn[p] = LEDColor(P[p].L);
+                if (splatMode)
+                {
+                    splats.add(sx, sy, P[p].L.getR(), P[p].L.getG(), P[p].L.getB());
+                }
+                else if (glowLights && view.is_visible(sx, sy, glowRadius))
+                {
+                    draw_glow(renderer, sx, sy, ledsize, P[p].L);
+                }
+            }
+            splats.flush(renderer);
+        }
+        else if (glowLights)
+        {
+            // the first LED of every segment, to go from the segments near a changed LED to its neighbours
+            segment_first.resize(segments.size() + 1);
+            segment_first[0] = 0;
+            for (int s = 0; s < segments.size(); s++)
+            {
+                segment_first[s + 1] = segment_first[s] + segments[s].pixels;
+            }
+            // along a curve the changed LEDs after one another are near each other, and so are the
+            // cells of segment_index they look their neighbours up in
+            if (shading_order.built && shading_order.curve != ORDER_WIRING && shading_order.rank.size() == numpix)
+            {
+                std::sort(preview.changed.begin(), preview.changed.end(), [](int a, int b) {return shading_order.rank[a] < shading_order.rank[b];});
+            }
+            for (std::vector<int>::iterator ip = preview.changed.begin(); ip != preview.changed.end(); ++ip)
+            {
+                float cx = view.to_screen_x(P[*ip].x);
+                float cy = view.to_screen_y(P[*ip].y);
+                if (!view.is_visible(cx, cy, glowRadius))
+                {
+                    preview.drawn[*ip] = LEDColor(P[*ip].L);
+                    continue;
+                }
+                SDL_Rect region;
+                region.x = cx - glowRadius;
+                region.y = cy - glowRadius;
+                region.w = region.h = 2 * glowRadius + 1;
+                SDL_RenderSetClipRect(renderer, &region);
+                SDL_RenderCopy(renderer, preview.background, &region, &region);
+                // the neighbours whose glow reaches into the region are repainted within it. only
+                // the changed LED is repainted completely, the others keep the color they were
+                // last drawn with as their baseline, so that their drift still adds up to a redraw
+                float reach = 2 * glowRadius / view.scale();
+                segment_index.query_box(P[*ip].x - reach, P[*ip].y - reach, P[*ip].x + reach, P[*ip].y + reach, candidates);
+                for (std::vector<int>::iterator is = candidates.begin(); is != candidates.end(); ++is)
+                {
+                    for (int p = segment_first[*is]; p < segment_first[*is + 1] && p < numpix; p++)
+                    {
+                        float sx = view.to_screen_x(P[p].x);
+                        float sy = view.to_screen_y(P[p].y);
+                        if (fabs(sx - cx) < 2 * glowRadius && fabs(sy - cy) < 2 * glowRadius)
+                        {
+                            draw_glow(renderer, sx, sy, ledsize, P[p].L);
+                        }
+                    }
+                }
+                preview.drawn[*ip] = LEDColor(P[*ip].L);
+                SDL_RenderSetClipRect(renderer, NULL);
+            }
+        }
+        SDL_SetRenderTarget(renderer, NULL);
+
+        SDL_RenderCopy(renderer, preview.lights, NULL, NULL);
+        SDL_RenderCopy(renderer, preview.overlay, NULL, NULL);
+        preview.dirty = false;
+        PROFILE_END(STAGE_LIGHTS);
+        stamp.mark(STAMP_COLORED);
+
+#ifdef SHADY_PROFILE
+        if (frames++ % 30 == 0)
+        {
+            profile_collect(profile_stats);
+        }
+        if (showHud)
+        {
+            profile_draw_hud(renderer, profile_stats);
+        }
+#endif
+
+        PROFILE_BEGIN(STAGE_PRESENT);
         SDL_RenderPresent(renderer);
+        PROFILE_END(STAGE_PRESENT);
+        stamp.mark(STAMP_PRESENTED);
+        if (latency.enabled)
+        {
+            latency.add(stamp);
+        }
         if (debug)
         {
             SDL_Delay(5);
         }
+        TRACE_FRAME_END();
+        PROFILE_END(STAGE_FRAME);
+
+        if (metrics.running)
+        {
+            double frame_end = SimClock::now();
+            metrics.frame_time.observe(frame_end - frame_start);
+            metrics.latency.observe(stamp.total());
+            metrics.uptime.set(frame_end - show_start);
+            metrics.time_drift.set(frame_end - show_start - clock.time() / SIM_RATE);
+            frame_start = frame_end;
+        }
 
-        time++;
-        proceed_pattern(time);
+        if (bench.alloc_check)
+        {
+            long long allocated = bench_allocations.load() - frame_allocations;
+            frame_allocations += allocated;
+            if (checked_frames >= BENCH_WARMUP_FRAMES && allocated > 0 && allocating_frames++ < 5)
+            {
+                printf("frame %li allocated %lli times\n", checked_frames, allocated);
+            }
+            if (++checked_frames >= BENCH_WARMUP_FRAMES + BENCH_DEFAULT_FRAMES)
+            {
+                quit = 1;
+            }
+        }
+    }
+
+    metrics.stop();
+    if (latency.enabled)
+    {
+        latency.report();
+    }
+
+#ifdef SHADY_PROFILE
+    tracer.stop();
+    if (attribution.enabled)
+    {
+        attribution.report();
+    }
+#endif
+    if (perf.enabled)
+    {
+        perf.report();
+        perf.close_all();
     }
 
+    preview.destroy();
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
+    if (bench.alloc_check)
+    {
+        printf("%i of %i frames allocated\n", allocating_frames, BENCH_DEFAULT_FRAMES);
+        return allocating_frames > 0 ? 1 : 0;
+    }
     return 0;
 }
 
 float pos[4];
+float pos_prev[4];
+float pos_shown[4];
 float vel[4];
 float ang[4];
 float lumi[4];
@@ -571,6 +1315,10 @@ float white[4];
 float hue[4];
 int counter[4];
 int counter_max[4];
+int phase_glow;
+int phase_ripple;
+int phase_waber1;
+int phase_waber2;
 
 #define globalHue 224
 #define WATER_HUE globalHue
@@ -583,12 +1331,29 @@ int counter_max[4];
 #define WATER_GRADIENT_EXPONENT 1.8
 #define WATER_Y_OFFSET 0.3
 #define WATER_Y_HEIGHT (1-WATER_Y_OFFSET)
+#define POS_MAX_STEP 0.1
+#define EXPLOSION_POINT 0.3
+#define ROCKET_GLOW_WIDTH .02
+#define RING_RADIUS1 0.61
+#define RING_RADIUS2 0.36
+#define RING_WIDTH .003
+
+// what the shaders read besides the LED, for incremental shading
+enum ShaderInput
+{
+    INPUT_DROP,             // position, luminance and white of the water drops, one input each
+    INPUT_SPIRAL = INPUT_DROP + 3,  // phases of the leaf spiral
+    INPUT_FIREWORKS,        // rocket position and angle, ring hues
+    INPUT_SELECTION         // the selected segment, debug only
+};
 
 void init_pattern()
 {
     for (int s=0; s<4; s++)
     {
         pos[s] = 0.;
+        pos_prev[s] = 0.;
+        pos_shown[s] = 0.;
         vel[s] = 0.;
         ang[s] = 0.;
         lumi[s] = 0.;
@@ -609,10 +1374,22 @@ void init_pattern()
     counter_max[3] = 10;
     hue[0] = 300;
     hue[1] = 200;
+
+    phases.clear();
+    phase_glow = phases.add(200., 1.);
+    phase_ripple = phases.add(2 * M_PI, 0.2);
+    phase_waber1 = phases.add(2 * M_PI, 0.07);
+    phase_waber2 = phases.add(2 * M_PI, 0.09);
 }
 
 void proceed_pattern(float time)
 {
+    for (int s=0; s<4; s++)
+    {
+        pos_prev[s] = pos[s];
+    }
+    phases.advance(1);
+
     for(int p=0; p<3; p++)
     {
         pos[p] = vel[p] * counter[p];
@@ -646,10 +1423,135 @@ void proceed_pattern(float time)
     }
 }
 
+// positions in between two pattern steps, jumps (drop restarted, new rocket) are not smeared
+void interpolate_pattern(float alpha)
+{
+    phases.interpolate(alpha);
+    for (int s=0; s<4; s++)
+    {
+        if (fabs(pos[s] - pos_prev[s]) < POS_MAX_STEP)
+        {
+            pos_shown[s] = pos_prev[s] + alpha * (pos[s] - pos_prev[s]);
+        }
+        else
+        {
+            pos_shown[s] = pos[s];
+        }
+    }
+}
+
+vec2 rocket_position()
+{
+    return vec2(0.5 + (pos_shown[3] - 0.5) * sin(180./PI * ang[0]), pos_shown[3]);
+}
+
+// where the shader can light anything this frame. the rocket glow and the rings fade with
+// exp(-d^2 / width), beyond gaussian_cutoff they are black, like the tie outside the rings
+ShaderRegion shader_region(int pattern)
+{
+    if (debug || pattern != 1)
+    {
+        return ShaderRegion::all();
+    }
+    float explosionPoint = EXPLOSION_POINT;
+    if (pos_shown[3] >= explosionPoint)
+    {
+        return ShaderRegion::circle(rocket_position(), gaussian_cutoff(ROCKET_GLOW_WIDTH), LED());
+    }
+    float ringRadius1 = RING_RADIUS1 * (explosionPoint - pos_shown[3]);
+    float ringRadius2 = RING_RADIUS2 * (explosionPoint - pos_shown[3]);
+    float cutoff = gaussian_cutoff(RING_WIDTH);
+    return ShaderRegion::annulus(vec2(.5, explosionPoint), min(ringRadius1, ringRadius2) - cutoff, max(ringRadius1, ringRadius2) + cutoff, LED());
+}
+
+// where the band of water drop p is at height y, it covers 0 to WATER_SCALE
+float drop_offset(int p, float y)
+{
+    return (float)(pos_shown[p] - y + WATER_Y_OFFSET);
+}
+
+// what of the LED the shader reads, for separable shading. the tie water only depends on
+// the height, per type
+int shader_axis(int pattern, int type)
+{
+    if (!debug && pattern == 0 && type > 0)
+    {
+        return AXIS_V;
+    }
+    return AXIS_ALL;
+}
+
+// every value the shader reads besides the LED and the layout
+void shader_inputs(int pattern, int selected_segment, ShadeInputs &inputs)
+{
+    if (debug)
+    {
+        inputs.add(INPUT_SELECTION, selected_segment);
+        return;
+    }
+    switch (pattern)
+    {
+        case 0:
+            for (int p = 0; p < 3; p++)
+            {
+                inputs.add(INPUT_DROP + p, pos_shown[p]);
+                inputs.add(INPUT_DROP + p, lumi[p]);
+                inputs.add(INPUT_DROP + p, white[p]);
+            }
+            inputs.add(INPUT_SPIRAL, phases.get(phase_glow));
+            inputs.add(INPUT_SPIRAL, phases.get(phase_ripple));
+            inputs.add(INPUT_SPIRAL, phases.get(phase_waber1));
+            inputs.add(INPUT_SPIRAL, phases.get(phase_waber2));
+            break;
+        case 1:
+            inputs.add(INPUT_FIREWORKS, pos_shown[3]);
+            inputs.add(INPUT_FIREWORKS, ang[0]);
+            inputs.add(INPUT_FIREWORKS, hue[0]);
+            inputs.add(INPUT_FIREWORKS, hue[1]);
+            break;
+    }
+}
+
+// the inputs the color of an LED depends on in this frame, follows the branches of the shader
+unsigned shader_depends(int pattern, vec2 coord, int type)
+{
+    if (debug)
+    {
+        return 1u << INPUT_SELECTION;
+    }
+    switch (pattern)
+    {
+        case 0:
+            if (type > 0)
+            {
+                // the background where no drop is
+                unsigned drops = 0;
+                for (int p = 0; p < 3; p++)
+                {
+                    float ypos = drop_offset(p, coord.y);
+                    if (ypos >= 0 && ypos <= WATER_SCALE)
+                    {
+                        drops |= 1u << (INPUT_DROP + p);
+                    }
+                }
+                return drops;
+            }
+            return 1u << INPUT_SPIRAL;
+        case 1:
+            if (pos_shown[3] >= EXPLOSION_POINT || type == 0)
+            {
+                return 1u << INPUT_FIREWORKS;
+            }
+            return 0;
+    }
+    return ~0u;
+}
+
 LED shader(int pattern, float time, vec2 coord, int pixel, int segment, int type)
 {
     if (debug)
     {
+        SHADER_BRANCH("debug");
         if (segment == 0)
         {
             return LED(1, 1);
@@ -663,6 +1565,7 @@ LED shader(int pattern, float time, vec2 coord, int pixel, int segment, int type
 
             if (type > 0) // tie
             {
+                SHADER_BRANCH("tie water");
                 float hue = 0.;
                 if (type == 3)
                 {
@@ -680,7 +1583,7 @@ LED shader(int pattern, float time, vec2 coord, int pixel, int segment, int type
 
                 for(int p=0; p<3; p++)
                 {
-                    float ypos = (float)(pos[p] - coord.y + WATER_Y_OFFSET);
+                    float ypos = drop_offset(p, coord.y);
                     if (ypos >= 0 && ypos <= WATER_SCALE)
                     {
                         led.mix(LED(hue, white[p], lumi[p] * max(0., pow(1 - ypos / WATER_SCALE, WATER_GRADIENT_EXPONENT))), 1);
@@ -691,12 +1594,13 @@ LED shader(int pattern, float time, vec2 coord, int pixel, int segment, int type
             }
             else // leaves
             {
-                float r = sqrt(pow(coord.x - .5, 2) + pow(coord.y - .5, 2));
-                float phi = 180./PI * atan2(coord.y - .5, coord.x - .5);
+                SHADER_BRANCH("leaf spiral");
+                float r = attributes.r[pixel];
+                float phi = attributes.phi[pixel];
 
-                float modTime = fmod(time, 200.);
-                float glowEffect = exp(-pow(modTime - 100., 2.)/(150.)) * (.5 + .5 * sin(10. * r + 0.002 * phi - 0.2 * time));
-                float waberEffect = (.5 + .5 * sin(0.07 * time)) * (.5 + .5 * sin(0.09 * time));
+                float modTime = phases.get(phase_glow);
+                float glowEffect = exp(-pow(modTime - 100., 2.)/(150.)) * (.5 + .5 * sin(10. * r + 0.002 * phi - phases.get(phase_ripple)));
+                float waberEffect = (.5 + .5 * sin(phases.get(phase_waber1))) * (.5 + .5 * sin(phases.get(phase_waber2)));
                 float spiralHue = 120. - 20. * glowEffect - 10. * waberEffect;
                 float spiralWhite = 0.1 * glowEffect;
                 float spiralLumi = .6 + .3 * glowEffect + .2 * waberEffect;
@@ -708,23 +1612,25 @@ LED shader(int pattern, float time, vec2 coord, int pixel, int segment, int type
 
         case 1:
 
-            float explosionPoint = 0.3;
-            vec2 rocketPos = vec2(0.5 + (pos[3] - 0.5) * sin(180./PI * ang[0]), pos[3]);
-            if (pos[3] >= explosionPoint)
+            float explosionPoint = EXPLOSION_POINT;
+            vec2 rocketPos = rocket_position();
+            if (pos_shown[3] >= explosionPoint)
             {
+                SHADER_BRANCH("rocket");
                 float rocketHue = hue[0] + 30 * exp(-pow(coord.get_distance_to(rocketPos), 2.)/.1);
                 //float rocketWhite = exp(-pow(coord.get_distance_to(rocketPos), 2.)/.01);
-                float rocketLumi = exp(-pow(coord.get_distance_to(rocketPos), 2.)/.02);
+                float rocketLumi = exp(-pow(coord.get_distance_to(rocketPos), 2.)/ROCKET_GLOW_WIDTH);
 
                 return LED(rocketHue, 0, rocketLumi);
             }
             else if (type == 0)
             {
+                SHADER_BRANCH("rings");
                 float radiusFromCenter = coord.get_distance_to(vec2(.5, explosionPoint));
-                float ringRadius1 = 0.61 * (explosionPoint - pos[3]);
-                float ringRadius2 = 0.36 * (explosionPoint - pos[3]);
-                float ringLumi1 = exp(-pow(ringRadius1 - radiusFromCenter, 2.)/.003);
-                float ringLumi2 = exp(-pow(ringRadius2 - radiusFromCenter, 2.)/.003);
+                float ringRadius1 = RING_RADIUS1 * (explosionPoint - pos_shown[3]);
+                float ringRadius2 = RING_RADIUS2 * (explosionPoint - pos_shown[3]);
+                float ringLumi1 = exp(-pow(ringRadius1 - radiusFromCenter, 2.)/RING_WIDTH);
+                float ringLumi2 = exp(-pow(ringRadius2 - radiusFromCenter, 2.)/RING_WIDTH);
                 LED ring1 = LED(hue[0], 0, ringLumi1);
                 LED ring2 = LED(hue[1], 0, ringLumi2);
                 ring1.mix(ring2, 1);
@@ -733,6 +1639,7 @@ LED shader(int pattern, float time, vec2 coord, int pixel, int segment, int type
             }
             else
             {
+                SHADER_BRANCH("tie dark");
                 return LED();
             }
 
@@ -745,7 +1652,7 @@ LED shader(int pattern, float time, vec2 coord, int pixel, int segment, int type
     }
 }
 
-void print_all_segments(std::vector<Segment> segments)
+void print_all_segments(std::vector<Segment> &segments)
 {
     printf("\n");
     printf("    segments.clear();\n");
@@ -756,4 +1663,454 @@ void print_all_segments(std::vector<Segment> segments)
             (iseg - segments.begin()), iseg->get_length(), iseg->get_length()/distance_LED_in_cm);
     }
     printf("\n");
-}
\ No newline at end of file
+}
+
+void draw_glow(SDL_Renderer *renderer, float x, float y, float size, LED L)
+{
+    for (int i=0; i<4; i++)
+    {
+        float step = 1 + .25 * i;
+        float intensity = pow(.5, i);
+        filledCircleColor(renderer, x, y, size * step, LEDColor(L, intensity));
+    }
+}
+
+bool decode_event(SDL_Event &e, Viewport &view, EditorCommand &command)
+{
+    static vec2 box_start;
+    static bool box_dragging = false;
+
+    switch (e.type)
+    {
+        case SDL_MOUSEBUTTONDOWN:
+        {
+            if (e.button.button != SDL_BUTTON_LEFT)
+            {
+                return false;
+            }
+            vec2 click = view.to_world(e.button.x, e.button.y);
+            if (SDL_GetModState() & KMOD_SHIFT)
+            {
+                box_start = click;
+                box_dragging = true;
+                return false;
+            }
+            command = EditorCommand(CMD_CLICK, click.x, click.y);
+            return true;
+        }
+
+        case SDL_MOUSEBUTTONUP:
+        {
+            if (e.button.button != SDL_BUTTON_LEFT || !box_dragging)
+            {
+                return false;
+            }
+            box_dragging = false;
+            vec2 release = view.to_world(e.button.x, e.button.y);
+            if (box_start.get_distance_to(release) * view.scale() < 4)
+            {
+                command = EditorCommand(CMD_SELECT_AT, release.x, release.y);
+            }
+            else
+            {
+                command = EditorCommand(CMD_SELECT_BOX, box_start.x, box_start.y, release.x, release.y);
+            }
+            return true;
+        }
+
+        case SDL_KEYDOWN:
+            switch (e.key.keysym.sym)
+            {
+                case SDLK_BACKSPACE: command = EditorCommand(CMD_REMOVE_LAST); return true;
+                case SDLK_SPACE: command = EditorCommand(CMD_CLEAR); return true;
+                case SDLK_w: command = EditorCommand(CMD_MOVE, 0.f, -0.1f); return true;
+                case SDLK_s: command = EditorCommand(CMD_MOVE, 0.f, +0.1f); return true;
+                case SDLK_d: command = EditorCommand(CMD_MOVE, +0.1f, 0.f); return true;
+                case SDLK_a: command = EditorCommand(CMD_MOVE, -0.1f, 0.f); return true;
+                case SDLK_e: command = EditorCommand(CMD_TURN, -1.f, 0.f); return true;
+                case SDLK_q: command = EditorCommand(CMD_TURN, +1.f, 0.f); return true;
+                case SDLK_r: command = EditorCommand(CMD_CHANGE_LENGTH, 1); return true;
+                case SDLK_f: command = EditorCommand(CMD_CHANGE_LENGTH, -1); return true;
+                case SDLK_t: command = EditorCommand(CMD_FLIP); return true;
+                case SDLK_x: command = EditorCommand(CMD_SWAP_NEXT); return true;
+                case SDLK_y: command = EditorCommand(CMD_SWAP_PREVIOUS); return true;
+                case SDLK_UP: command = EditorCommand(CMD_SELECT, 1); return true;
+                case SDLK_DOWN: command = EditorCommand(CMD_SELECT, -1); return true;
+                case SDLK_ESCAPE: command = EditorCommand(CMD_QUIT); return true;
+                case SDLK_RETURN: command = EditorCommand(CMD_EXPORT); return true;
+                case SDLK_TAB: command = EditorCommand(CMD_NEXT_PATTERN); return true;
+            }
+            return false;
+
+        case SDL_QUIT:
+            command = EditorCommand(CMD_QUIT);
+            return true;
+    }
+    return false;
+}
+
+void index_segment(SpatialGrid &grid, Segment &segment, int id)
+{
+    grid.remove(id);
+    for (int p = 0; p < segment.pixels; p++)
+    {
+        vec2 pixel = segment.get_pixel(p);
+        grid.insert(id, pixel.x, pixel.y);
+    }
+}
+
+int pick_segment(SpatialGrid &grid, std::vector<Segment> &segments, vec2 coord, std::vector<int> &candidates)
+{
+    int picked = -1;
+    float best = segment_pick_radius;
+    grid.query_radius(coord.x, coord.y, segment_pick_radius + segment_index_cell, candidates);
+    for (std::vector<int>::iterator it = candidates.begin(); it != candidates.end(); ++it)
+    {
+        float distance = segments[*it].get_distance_to(coord);
+        if (distance < best)
+        {
+            best = distance;
+            picked = *it;
+        }
+    }
+    return picked;
+}
+
+void print_segment_info(std::vector<Segment> &segments, int s, float width, float height)
+{
+    printf("selected segment %i \t %i pixels \t\t (%.2f, %.2f)  (%.2f, %.2f) \t\t ANTI [ (%.2f, %.2f)  (%.2f, %.2f) ] \n", s, segments[s].pixels,
+                                        segments[s].origin_x - originOffsetX, segments[s].origin_y - originOffsetY,
+                                        segments[s].get_last_pixel_plus_one().x - originOffsetX, segments[s].get_last_pixel_plus_one().y - originOffsetY,
+                                        width - segments[s].origin_x - originOffsetX, height - segments[s].origin_y - originOffsetY,
+                                        width - segments[s].get_last_pixel_plus_one().x - originOffsetX, height - segments[s].get_last_pixel_plus_one().y - originOffsetY);
+}
+
+void shade_frame(std::vector<Pixel> &P, std::vector<Segment> &segments, int pattern, float time, float width, float height, int selected_segment)
+{
+    attributes.update(segments, pattern_attributes[pattern], width, height);
+    // P keeps its storage from frame to frame, it only grows when the layout did
+    int count = 0;
+    for (std::vector<Segment>::iterator iseg = segments.begin(); iseg != segments.end(); ++iseg)
+    {
+        count += iseg->pixels;
+    }
+    P.resize(count);
+    int i = 0;
+    for (std::vector<Segment>::iterator iseg = segments.begin(); iseg != segments.end(); ++iseg)
+    {
+        int segcount = iseg - segments.begin();
+        for (int p = 0; p < iseg->pixels; p++, i++)
+        {
+            Pixel &pixel = P[i];
+            vec2 coord = iseg->get_pixel(p);
+            pixel.x = coord.x;
+            pixel.y = coord.y;
+            pixel.segcount = segcount;
+            vec2 relative_coord = vec2(pixel.x/width, pixel.y/height);
+            ATTRIBUTE_BEGIN();
+            pixel.L = shader(pattern, time, relative_coord, i, segcount - selected_segment, iseg->type);
+            ATTRIBUTE_END(pattern);
+        }
+    }
+}
+
+// shading, preview change detection and packing the output frame on generated layouts of
+// growing size (--bench --scaling), to see where the cost per pixel stops being flat
+void bench_scale(BenchSuite &suite, BenchOptions &bench)
+{
+    const int sizes[] = {1000, 3000, 10000, 30000, 100000, 300000, 1000000};
+    std::vector<Segment> segments;
+    std::vector<Pixel> P;
+    std::vector<unsigned char> output;
+    PreviewCache preview;
+    char name[64];
+    // after the generated kinds the grid once more with every row tie water, which only
+    // depends on the height (--separable)
+    for (int kind = 0; kind <= SYNTH_KIND_COUNT; kind++)
+    {
+        bool ties = kind == SYNTH_KIND_COUNT;
+        for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        {
+            snprintf(name, sizeof(name), "scaling/%s/%i", ties ? "ties" : synthetic_kind_names[kind], sizes[s]);
+            if (!bench.wanted(name))
+            {
+                continue;
+            }
+            SyntheticExtent extent = generate_layout(segments, ties ? SYNTH_GRID : kind, sizes[s], distance_LED_in_cm, 1);
+            for (int t = 0; ties && t < segments.size(); t++)
+            {
+                segments[t].type = 3;
+            }
+            invalidate_layout();
+            int frames = max(min(bench.frames, (int)(bench.frames * 1000LL / sizes[s])), 3);
+            // the curve orders where the wiring is far from spatial order, soups and serpentines
+            int curves = kind == SYNTH_SOUP || kind == SYNTH_GRID ? ORDER_CURVE_COUNT : 1;
+            for (int curve = 0; curve < curves; curve++)
+            {
+                shading_order.curve = curve;
+                shading_order.invalidate();
+                for (int pattern = 0; pattern < nr_of_patterns; pattern++)
+                {
+                    BenchStage shade, changes, pack;
+                    init_pattern();
+                    preview.dirty = true;
+                    for (long frame = 0; frame < BENCH_WARMUP_FRAMES + frames; frame++)
+                    {
+                        if (frame == BENCH_WARMUP_FRAMES)
+                        {
+                            shade = changes = pack = BenchStage();
+                        }
+                        proceed_pattern(frame + 1);
+                        interpolate_pattern(1);
+
+                        // along a curve the colors go back to wiring order within the shading
+                        shade.begin();
+                        shade_figure(P, segments, -1, pattern, frame + 1, extent.width, extent.height, 0);
+                        shade.end();
+
+                        // shaded incrementally, only the LEDs that were shaded again are packed
+                        pack.begin();
+                        const DirtyBitmap *shaded = incremental ? &shade_cache.dirty : NULL;
+                        output.resize(3 * P.size());
+                        if (shaded != NULL)
+                        {
+                            shaded->visit([&](int p)
+                            {
+                                output[3 * p] = P[p].L.getG();
+                                output[3 * p + 1] = P[p].L.getR();
+                                output[3 * p + 2] = P[p].L.getB();
+                            });
+                        }
+                        else
+                        {
+                            for (int p = 0; p < P.size(); p++)
+                            {
+                                output[3 * p] = P[p].L.getG();
+                                output[3 * p + 1] = P[p].L.getR();
+                                output[3 * p + 2] = P[p].L.getB();
+                            }
+                        }
+                        pack.end();
+
+                        changes.begin();
+                        bool full = preview.collect_changes(P, shaded);
+                        for (int i = 0; i < (full ? P.size() : preview.changed.size()); i++)
+                        {
+                            int p = full ? i : preview.changed[i];
+                            preview.drawn[p] = LEDColor(P[p].L);
+                        }
+                        preview.dirty = false;
+                        changes.end();
+                    }
+                    char stage[96];
+                    const char *order = curve == ORDER_WIRING ? "" : pixel_curve_names[curve];
+                    snprintf(stage, sizeof(stage), "%s/pattern%i/%s%sshade", name, pattern, order, *order ? "/" : "");
+                    suite.add_frames(stage, shade, frames, P.size());
+                    snprintf(stage, sizeof(stage), "%s/pattern%i/%s%spreview", name, pattern, order, *order ? "/" : "");
+                    suite.add_frames(stage, changes, frames, P.size());
+                    snprintf(stage, sizeof(stage), "%s/pattern%i/%s%soutput", name, pattern, order, *order ? "/" : "");
+                    suite.add_frames(stage, pack, frames, P.size());
+                }
+            }
+        }
+    }
+    shading_order.curve = ORDER_WIRING;
+}
+
+template<int N> void shade_baked(std::vector<Pixel> &P, const BakedTable<N> &table, int pattern, float time, int selected_segment)
+{
+    P.resize(N);
+    for (int i = 0; i < N; i++)
+    {
+        const BakedPixel &baked = table.pixels[i];
+        Pixel &pixel = P[i];
+        pixel.x = baked.x;
+        pixel.y = baked.y;
+        pixel.segcount = baked.segment;
+        ATTRIBUTE_BEGIN();
+        pixel.L = shader(pattern, time, vec2(baked.u, baked.v), i, baked.segment - selected_segment, baked.type);
+        ATTRIBUTE_END(pattern);
+    }
+}
+
+// the LEDs straight from the mapped layout file, like shade_baked from its table
+void shade_mapped(std::vector<Pixel> &P, LayoutFile &layout, int figure, int pattern, float time, float width, float height, int selected_segment)
+{
+    const LayoutPixel *stored = layout.get_pixels(figure);
+    const LayoutSegment *stored_segments = layout.get_segments(figure);
+    P.resize(layout.get_figure(figure).pixels);
+    for (int i = 0; i < P.size(); i++)
+    {
+        Pixel &pixel = P[i];
+        pixel.x = stored[i].x;
+        pixel.y = stored[i].y;
+        pixel.segcount = stored[i].segment;
+        ATTRIBUTE_BEGIN();
+        pixel.L = shader(pattern, time, vec2(stored[i].x/width, stored[i].y/height), i, stored[i].segment - selected_segment, stored_segments[stored[i].segment].type);
+        ATTRIBUTE_END(pattern);
+    }
+}
+
+// stored_figure is the compiled in or loaded figure the segments still are, or -1
+void shade_figure(std::vector<Pixel> &P, std::vector<Segment> &segments, int stored_figure, int pattern, float time, float width, float height, int selected_segment)
+{
+    attributes.update(segments, pattern_attributes[pattern], width, height);
+    if (shade_sequence(P, segments, pattern, time, width, height, selected_segment))
+    {
+        return;
+    }
+    if (shading_order.curve != ORDER_WIRING)
+    {
+        if (!shading_order.built)
+        {
+            shading_order.build(segments, P, width, height);
+        }
+        shade_ordered(pattern, time, selected_segment);
+        shading_order.remap(P);
+        return;
+    }
+    if (stored_figure >= 0 && mapped_layout != NULL)
+    {
+        shade_mapped(P, *mapped_layout, stored_figure, pattern, time, width, height, selected_segment);
+        return;
+    }
+#ifdef BAKED_LAYOUT
+    switch (stored_figure)
+    {
+        case 0: shade_baked(P, baked_figure1, pattern, time, selected_segment); return;
+        case 1: shade_baked(P, baked_figure2, pattern, time, selected_segment); return;
+        case 2: shade_baked(P, baked_figure3, pattern, time, selected_segment); return;
+    }
+#endif
+    shade_frame(P, segments, pattern, time, width, height, selected_segment);
+}
+
+// the LEDs in the order of shading_order, into its buffer
+void shade_ordered(int pattern, float time, int selected_segment)
+{
+    for (int k = 0; k < shading_order.pixels.size(); k++)
+    {
+        const OrderedPixel &pixel = shading_order.pixels[k];
+        ATTRIBUTE_BEGIN();
+        shading_order.shaded[k] = shader(pattern, time, vec2(pixel.u, pixel.v), pixel.wiring, pixel.segment - selected_segment, pixel.type);
+        ATTRIBUTE_END(pattern);
+    }
+}
+
+// after the segments were edited or replaced
+void invalidate_layout()
+{
+    attributes.invalidate();
+    shading_order.invalidate();
+    region_grid.invalidate();
+    shade_cache.invalidate();
+    separable.invalidate();
+}
+
+// culling, incremental and separable shading over the LEDs in the order of shading_order,
+// along the wiring unless --order chose a curve. they go together: an LED outside the region
+// of the pattern gets its background, incrementally only when it is stale, and an LED of a
+// separable group gets the color of its group, shaded once per frame when first needed.
+// false when none of them applies this frame
+bool shade_sequence(std::vector<Pixel> &P, std::vector<Segment> &segments, int pattern, float time, float width, float height, int selected_segment)
+{
+    ShaderRegion region = culling ? shader_region(pattern) : ShaderRegion::all();
+    bool culled = region.shape != REGION_ALL;
+    if (!incremental && !separable_shading && !culled)
+    {
+        return false;
+    }
+    std::vector<OrderedPixel> &pixels = shading_order.pixels;
+    if (!shading_order.built || P.size() != pixels.size())
+    {
+        // the positions are not rewritten by the passes below
+        shading_order.build(segments, P, width, height);
+        region_grid.invalidate();
+        shade_cache.invalidate();
+        separable.invalidate();
+    }
+    int count = pixels.size();
+    if (separable_shading && (!separable.built || separable.pattern != pattern))
+    {
+        attributes.update(segments, ATTR_SEGMENT, width, height);
+        separable.build(pattern, count, [&](int k)
+        {
+            const OrderedPixel &pixel = pixels[k];
+            return separable_key(shader_axis(pattern, pixel.type), pixel.type, pixel.u, pixel.v, attributes.index[pixel.wiring]);
+        });
+    }
+    bool grouped = separable_shading && !separable.first.empty();
+    if (!incremental && !grouped && !culled)
+    {
+        return false;
+    }
+
+    separable.begin();
+    auto shade = [&](int k)
+    {
+        int g = grouped ? separable.group[k] : -1;
+        if (g >= 0 && !separable.needs(g))
+        {
+            return separable.color[g];
+        }
+        const OrderedPixel &pixel = pixels[g >= 0 ? separable.first[g] : k];
+        LED L;
+        ATTRIBUTE_BEGIN();
+        L = shader(pattern, time, vec2(pixel.u, pixel.v), pixel.wiring, pixel.segment - selected_segment, pixel.type);
+        ATTRIBUTE_END(pattern);
+        if (g >= 0)
+        {
+            separable.color[g] = L;
+        }
+        return L;
+    };
+
+    if (incremental)
+    {
+        // only the LEDs whose inputs changed since the last frame, they are marked in
+        // shade_cache.dirty. the background is the same every frame
+        if (!shade_cache.valid || shade_cache.pattern != pattern)
+        {
+            shade_cache.reset(pattern, count);
+        }
+        shade_cache.inputs.begin();
+        shader_inputs(pattern, selected_segment, shade_cache.inputs);
+        shade_cache.inputs.end();
+        shade_cache.dirty.clear();
+        for (int k = 0; k < count; k++)
+        {
+            const OrderedPixel &pixel = pixels[k];
+            bool outside = culled && !region.contains(pixel.u, pixel.v);
+            if (!shade_cache.stale(k, outside ? 0 : shader_depends(pattern, vec2(pixel.u, pixel.v), pixel.type)))
+            {
+                continue;
+            }
+            P[pixel.wiring].L = outside ? region.background : shade(k);
+            shade_cache.dirty.set(pixel.wiring);
+        }
+    }
+    else if (culled)
+    {
+        // only the LEDs within the region, found through the grid
+        if (!region_grid.built)
+        {
+            region_grid.build(pixels);
+        }
+        for (int i = 0; i < P.size(); i++)
+        {
+            P[i].L = region.background;
+        }
+        region_grid.visit(region, pixels, [&](int k)
+        {
+            P[pixels[k].wiring].L = shade(k);
+        });
+    }
+    else
+    {
+        for (int k = 0; k < count; k++)
+        {
+            P[pixels[k].wiring].L = shade(k);
+        }
+    }
+    return true;
+}
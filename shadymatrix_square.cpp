@@ -7,6 +7,10 @@
 #include "LED_WS.h"
 #include "pixel.h"
 #include "helper.h"
+#include "clock.h"
+#include "phase.h"
+#include "bench.h"
+#include "golden.h"
 
 #define PI 3.141592
 #define numpix P.size()
@@ -80,11 +84,15 @@ struct Segment
 int count_LEDs_in_cross_matrix(int, int);
 void init_pattern();
 void proceed_pattern(float time);
+void interpolate_pattern(float alpha);
 LED shader(float time, vec2 coord, int pixel, int segment, int type);
-void print_all_segments(std::vector<Segment> segments);
+void shade_frame(std::vector<Pixel> &P, std::vector<Segment> &segments, float time, float width, float height, int selected_segment);
+void print_all_segments(std::vector<Segment> &segments);
 
 bool debug = false;
 
+PhaseBank phases;
+
 int main(int argc, char* argv[])
 {
     SDL_Event e;
@@ -110,9 +118,20 @@ int main(int argc, char* argv[])
     int selected_segment = 0;
     int selected_figure = 0;
 
-    if (argc > 1)
+    BenchOptions bench;
+    bench.parse(argc, argv);
+    GoldenRun golden;
+    golden.parse(argc, argv);
+
+    if (argc > 1 && !std::strcmp(argv[1], "--soak"))
+    {
+        init_pattern();
+        return soak_phases(phases, argc > 2 ? atof(argv[2]) : 30, SIM_RATE) ? 1 : 0;
+    }
+
+    if (argc > 1 && argv[1][0] >= '0' && argv[1][0] <= '9')
     {
-        selected_figure = (int)argv[1][0];
+        selected_figure = atoi(argv[1]);
     }
 
     /// PATTERN
@@ -126,10 +145,44 @@ int main(int argc, char* argv[])
     figures.clear();
     figures.push_back(segments);
 
-    segments = figures[selected_figure];
+    segments = figures[selected_figure % figures.size()];
 
     /// END PATTERN
 
+    if (golden.enabled())
+    {
+        srandom(GOLDEN_SEED);
+        init_pattern();
+        for (long frame = 0; frame < golden.frames; frame++)
+        {
+            shade_frame(P, segments, frame, width, height, selected_segment);
+            golden.add("square", frame, P);
+            proceed_pattern(frame + 1);
+            interpolate_pattern(1);
+        }
+        return golden.finish();
+    }
+
+    if (bench.frames > 0)
+    {
+        BenchSuite suite;
+        BenchTimer timer;
+        long frame = 0;
+        init_pattern();
+        for (; frame < BENCH_WARMUP_FRAMES + bench.frames; frame++)
+        {
+            if (frame == BENCH_WARMUP_FRAMES)
+            {
+                timer = BenchTimer();
+            }
+            shade_frame(P, segments, frame, width, height, selected_segment);
+            proceed_pattern(frame + 1);
+            interpolate_pattern(1);
+        }
+        suite.add_frames("square", timer, bench.frames, numpix);
+        return bench.finish(suite, argv[0]);
+    }
+
     float meters_required = numpix * distance_LED_in_m;
     printf("Pixels: %i\nMeters: %g\nWidth: %g\nHeight: %g\n", numpix, meters_required, width, height);
 
@@ -179,7 +232,7 @@ int main(int argc, char* argv[])
     float new_origin_x, new_origin_y, new_to_x, new_to_y;
 
     int quit = 0;
-    long time = 0;
+    SimClock clock;
     bool firstClick = true;
 
     init_pattern();
@@ -359,18 +412,13 @@ int main(int argc, char* argv[])
         }
 
         //////////// PATTERN ////////////
-        P.clear();
-        for (std::vector<Segment>::iterator iseg = segments.begin(); iseg != segments.end(); ++iseg)
+        int steps = clock.advance(SimClock::now());
+        for (int step = 0; step < steps; step++)
         {
-            int segcount = iseg - segments.begin();
-            for (int p = 0; p < iseg->pixels; p++)
-            {
-                Pixel pixel = Pixel(iseg->get_pixel(p), segcount);
-                vec2 relative_coord = vec2(pixel.x/width, pixel.y/height);
-                pixel.L = shader(time, relative_coord, numpix, segcount - selected_segment, iseg->type);
-                P.push_back(pixel);
-            }
+            proceed_pattern(clock.ticks - steps + step + 1);
         }
+        interpolate_pattern(clock.alpha());
+        shade_frame(P, segments, clock.time(), width, height, selected_segment);
 
         //////////// LIGHTS ////////////
         for(int p = 0; p < numpix; p++)
@@ -429,9 +477,6 @@ int main(int argc, char* argv[])
         {
             SDL_Delay(5);
         }
-
-        time++;
-        proceed_pattern(time);
     }
 
     SDL_DestroyRenderer(renderer);
@@ -441,12 +486,15 @@ int main(int argc, char* argv[])
 }
 
 float pos[4];
+float pos_prev[4];
+float pos_shown[4];
 float vel[4];
 float ang[4];
 float lumi[4];
 float white[4];
 int counter[3];
 int counter_max[3];
+int phase_spiral;
 
 #define globalHue 224
 #define WATER_HUE globalHue
@@ -460,11 +508,16 @@ int counter_max[3];
 #define WATER_WHITE_EXPONENT 2.6
 #define WATER_Y_OFFSET 0.47
 
+// a drop that starts over jumps back to the top instead of sliding there
+#define POS_MAX_STEP 0.1
+
 void init_pattern()
 {
     for (int s=0; s<4; s++)
     {
         pos[s] = 0.;
+        pos_prev[s] = 0.;
+        pos_shown[s] = 0.;
         vel[s] = 0.;
         ang[s] = 0.;
         lumi[s] = 0.;
@@ -478,10 +531,19 @@ void init_pattern()
     counter[0] = 0;
     counter[1] = -WATER_PERIOD_MIN / 3;
     counter[2] = -WATER_PERIOD_MIN * 2 / 3;
+
+    phases.clear();
+    phase_spiral = phases.add(2 * M_PI, 0.2);
 }
 
 void proceed_pattern(float time)
 {
+    for (int s=0; s<4; s++)
+    {
+        pos_prev[s] = pos[s];
+    }
+    phases.advance(1);
+
     for(int p=0; p<3; p++)
     {
         if (counter[p] < counter_max[p])
@@ -500,6 +562,22 @@ void proceed_pattern(float time)
     // printf("STEP %f %i %i %f\n", pos[0], counter[0], counter_max[0], white[0]);
 }
 
+void interpolate_pattern(float alpha)
+{
+    phases.interpolate(alpha);
+    for (int s=0; s<4; s++)
+    {
+        if (fabs(pos[s] - pos_prev[s]) < POS_MAX_STEP)
+        {
+            pos_shown[s] = pos_prev[s] + alpha * (pos[s] - pos_prev[s]);
+        }
+        else
+        {
+            pos_shown[s] = pos[s];
+        }
+    }
+}
+
 // Reminder: coord is scaled as [0,1] in each dimension.
 LED shader(float time, vec2 coord, int pixel, int segment, int type)
 {
@@ -518,7 +596,7 @@ LED shader(float time, vec2 coord, int pixel, int segment, int type)
 
         for(int p=0; p<3; p++)
         {
-            float ypos = (float)(pos[p] - coord.y + WATER_Y_OFFSET);
+            float ypos = (float)(pos_shown[p] - coord.y + WATER_Y_OFFSET);
             if (ypos >= 0)
             {
                 led.mix(LED(WATER_HUE, white[p], lumi[p] * max(0., (1 - ypos / WATER_SCALE))), 1);
@@ -533,7 +611,7 @@ LED shader(float time, vec2 coord, int pixel, int segment, int type)
 
         float r = sqrt(pow(coord.x - .5, 2) + pow(coord.y - .5, 2));
         float phi = 180./PI * atan2(coord.y - .5, coord.x - .5);
-        float spiralHue = 100. + 30. * sin(10. * r + 0.01 * phi - 0.2 * time);
+        float spiralHue = 100. + 30. * sin(10. * r + 0.01 * phi - phases.get(phase_spiral));
 
         LED led_spiral = LED(spiralHue, 0, 1);
 
@@ -543,7 +621,7 @@ LED shader(float time, vec2 coord, int pixel, int segment, int type)
     }
 }
 
-void print_all_segments(std::vector<Segment> segments)
+void print_all_segments(std::vector<Segment> &segments)
 {
     printf("\n");
     printf("    segments.clear();\n");
@@ -554,4 +632,30 @@ void print_all_segments(std::vector<Segment> segments)
             (iseg - segments.begin()), iseg->get_length(), iseg->get_length()/distance_LED_in_cm);
     }
     printf("\n");
-}
\ No newline at end of file
+}
+
+void shade_frame(std::vector<Pixel> &P, std::vector<Segment> &segments, float time, float width, float height, int selected_segment)
+{
+    // P keeps its storage from frame to frame, it only grows when the layout did
+    int count = 0;
+    for (std::vector<Segment>::iterator iseg = segments.begin(); iseg != segments.end(); ++iseg)
+    {
+        count += iseg->pixels;
+    }
+    P.resize(count);
+    int i = 0;
+    for (std::vector<Segment>::iterator iseg = segments.begin(); iseg != segments.end(); ++iseg)
+    {
+        int segcount = iseg - segments.begin();
+        for (int p = 0; p < iseg->pixels; p++, i++)
+        {
+            Pixel &pixel = P[i];
+            vec2 coord = iseg->get_pixel(p);
+            pixel.x = coord.x;
+            pixel.y = coord.y;
+            pixel.segcount = segcount;
+            vec2 relative_coord = vec2(pixel.x/width, pixel.y/height);
+            pixel.L = shader(time, relative_coord, i, segcount - selected_segment, iseg->type);
+        }
+    }
+}
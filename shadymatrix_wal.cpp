@@ -1,16 +1,25 @@
 #include <stdio.h>
 #include <cmath>
+#include <cstring>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL2_gfxPrimitives.h>
 #include <vector>
 #include "LED_WS.h"
 #include "pixel.h"
 #include "helper.h"
+#include "viewport.h"
+#include "clock.h"
+#include "phase.h"
+#include "bench.h"
+#include "golden.h"
 
 #define PI 3.141592
 #define numpix P.size()
 
 int count_LEDs_in_cross_matrix(int, int);
+void init_pattern();
+void proceed_pattern();
+void interpolate_pattern(float alpha);
 LED shader(float time, vec2 coord, int pixel, int segment);
 
 const float distance_LED_in_cm = 100. / 60.;
@@ -18,6 +27,8 @@ const float distance_LED_in_m = 0.01 * distance_LED_in_cm;
 
 bool debug = true;
 
+PhaseBank phases;
+
 struct Segment
 {
     float origin_x;
@@ -66,6 +77,8 @@ struct Segment
     }
 };
 
+void shade_frame(std::vector<Pixel> &P, std::vector<Segment> &segments, float time, float width, float height, int selected_segment);
+
 int main(int argc, char* argv[])
 {
     SDL_Event e;
@@ -84,6 +97,17 @@ int main(int argc, char* argv[])
 
     int selected_segment = 0;
 
+    BenchOptions bench;
+    bench.parse(argc, argv);
+    GoldenRun golden;
+    golden.parse(argc, argv);
+
+    if (argc > 1 && !std::strcmp(argv[1], "--soak"))
+    {
+        init_pattern();
+        return soak_phases(phases, argc > 2 ? atof(argv[2]) : 30, SIM_RATE) ? 1 : 0;
+    }
+
     // DER ECHTE WAL
     segments.clear();
     segments.push_back(Segment(69.80, 52.30, 66.58, 48.48));                             // Segment 0    Length 5.00     Pixels: 3
@@ -149,11 +173,44 @@ int main(int argc, char* argv[])
     }
     // */
 
+    if (golden.enabled())
+    {
+        srandom(GOLDEN_SEED);
+        init_pattern();
+        for (long frame = 0; frame < golden.frames; frame++)
+        {
+            shade_frame(P, segments, frame, width, height, selected_segment);
+            golden.add("whale", frame, P);
+            proceed_pattern();
+            interpolate_pattern(1);
+        }
+        return golden.finish();
+    }
+
+    if (bench.frames > 0)
+    {
+        BenchSuite suite;
+        BenchTimer timer;
+        long frame = 0;
+        init_pattern();
+        for (; frame < BENCH_WARMUP_FRAMES + bench.frames; frame++)
+        {
+            if (frame == BENCH_WARMUP_FRAMES)
+            {
+                timer = BenchTimer();
+            }
+            shade_frame(P, segments, frame, width, height, selected_segment);
+            proceed_pattern();
+            interpolate_pattern(1);
+        }
+        suite.add_frames("whale", timer, bench.frames, numpix);
+        return bench.finish(suite, argv[0]);
+    }
+
     float meters_required = numpix * distance_LED_in_m;
     printf("Pixels: %i\nMeters: %g\nWidth: %g\nHeight: %g\n", numpix, meters_required, width, height);
 
     const float SCALE = N * .3;
-    const float MARGIN = margin * SCALE;
     const float WIDTH = width * SCALE;
     const float HEIGHT = height * SCALE;
     const float LEDSIZE = 5;
@@ -181,50 +238,56 @@ int main(int argc, char* argv[])
         return 3;
     }
 
+    // wheel zooms at the cursor, right or middle drag pans, home resets the view
+    Viewport view = Viewport(SCALE, WIDTH, HEIGHT);
+    SplatBuffer splats;
+    splats.resize(WIDTH, HEIGHT);
+
     SDL_Rect margin_t, margin_b, margin_l, margin_r, margin_extra1, margin_extra2;
-    margin_t.x = 0;
-    margin_t.y = 0;
-    margin_b.x = 0;
-    margin_b.y = HEIGHT - MARGIN;
-    margin_l.x = 0;
-    margin_l.y = 0;
-    margin_r.x = WIDTH - MARGIN;
-    margin_r.y = 0;
-    margin_t.w = margin_b.w = WIDTH;
-    margin_t.h = margin_b.h = MARGIN;
-    margin_l.w = margin_r.w = MARGIN;
-    margin_l.h = margin_r.h = HEIGHT;
-    margin_extra1.w = margin_extra2.w = 8.2 * SCALE;
-    margin_extra1.h = margin_extra2.h = 5.5 * SCALE;
-    margin_extra1.x = margin_extra2.x = WIDTH - margin_extra1.w;
-    margin_extra1.y = 0;
-    margin_extra2.y = HEIGHT - margin_extra2.h;
 
     float new_origin_x, new_origin_y, new_to_x, new_to_y;
 
     int quit = 0;
-    long time = 0;
+    SimClock clock;
+    init_pattern();
     bool firstClick = true;
     while (!quit)
     {
-        if (SDL_PollEvent(&e))
+        while (SDL_PollEvent(&e))
         {
             switch (e.type)
             {
-                case SDL_MOUSEBUTTONDOWN:
+                case SDL_MOUSEMOTION:
+                    if (e.motion.state & (SDL_BUTTON_RMASK | SDL_BUTTON_MMASK))
+                    {
+                        view.pan(e.motion.xrel, e.motion.yrel);
+                    }
+                    break;
+
+                case SDL_MOUSEWHEEL:
+                {
                     int x, y;
                     SDL_GetMouseState(&x, &y);
+                    view.zoom_at(x, y, pow(ZOOM_STEP, e.wheel.y));
+                    break;
+                }
+
+                case SDL_MOUSEBUTTONDOWN:
+                    if (e.button.button != SDL_BUTTON_LEFT)
+                    {
+                        break;
+                    }
                     if (firstClick)
                     {
-                        new_origin_x = x / SCALE;
-                        new_origin_y = y / SCALE;
+                        new_origin_x = view.to_world(e.button.x, e.button.y).x;
+                        new_origin_y = view.to_world(e.button.x, e.button.y).y;
                         printf("(%g, %g, ...\n", new_origin_x, new_origin_y);
                         firstClick = false;
                     }
                     else
                     {
-                        new_to_x = x / SCALE;
-                        new_to_y = y / SCALE;
+                        new_to_x = view.to_world(e.button.x, e.button.y).x;
+                        new_to_y = view.to_world(e.button.x, e.button.y).y;
                         Segment new_seg = Segment(new_origin_x, new_origin_y, new_to_x, new_to_y);
                         segments.push_back(new_seg);
                         for (int p = 0; p < new_seg.pixels; p++)
@@ -303,6 +366,10 @@ int main(int argc, char* argv[])
                                                                 width - segments[selected_segment].get_last_pixel_plus_one().x, height - segments[selected_segment].get_last_pixel_plus_one().y);
                             break;
 
+                        case SDLK_HOME:
+                            view.reset();
+                            break;
+
                         case SDLK_ESCAPE:
                             quit = 1;
                             break;
@@ -331,6 +398,20 @@ int main(int argc, char* argv[])
         SDL_RenderClear(renderer);
 
         //////////// MARGIN /////////////
+        margin_t.x = margin_b.x = margin_l.x = view.to_screen_x(0);
+        margin_t.y = margin_l.y = margin_r.y = view.to_screen_y(0);
+        margin_b.y = view.to_screen_y(height - margin);
+        margin_r.x = view.to_screen_x(width - margin);
+        margin_t.w = margin_b.w = width * view.scale();
+        margin_t.h = margin_b.h = margin * view.scale();
+        margin_l.w = margin_r.w = margin * view.scale();
+        margin_l.h = margin_r.h = height * view.scale();
+        margin_extra1.w = margin_extra2.w = 8.2 * view.scale();
+        margin_extra1.h = margin_extra2.h = 5.5 * view.scale();
+        margin_extra1.x = margin_extra2.x = view.to_screen_x(width - 8.2);
+        margin_extra1.y = view.to_screen_y(0);
+        margin_extra2.y = view.to_screen_y(height - 5.5);
+
         SDL_SetRenderDrawColor(renderer, 20, 20, 20, 255);
         SDL_RenderFillRect(renderer, &margin_t);
         SDL_RenderFillRect(renderer, &margin_b);
@@ -340,33 +421,43 @@ int main(int argc, char* argv[])
         SDL_RenderFillRect(renderer, &margin_extra2);
 
         //////////// PATTERN ////////////
-        P.clear();
-        for (std::vector<Segment>::iterator iseg = segments.begin(); iseg != segments.end(); ++iseg)
+        int steps = clock.advance(SimClock::now());
+        for (int step = 0; step < steps; step++)
         {
-            int segcount = iseg - segments.begin();
-            for (int p = 0; p < iseg->pixels; p++)
-            {
-                Pixel pixel = Pixel(iseg->get_pixel(p), segcount);
-                vec2 relative_coord = vec2(pixel.x/width, pixel.y/height);
-                pixel.L = shader(time, relative_coord, numpix, segcount - selected_segment);
-                P.push_back(pixel);
-            }
+            proceed_pattern();
         }
+        interpolate_pattern(clock.alpha());
+        shade_frame(P, segments, clock.time(), width, height, selected_segment);
 
         //////////// RENDER ////////////
+        float ledsize = LEDSIZE * view.zoom;
+        bool splatMode = ledsize < 1;
+        bool glowLights = numpix < 1000 && !debug;
+        float radius = glowLights ? 2.5 * ledsize : ledsize;
         for(int p = 0; p < numpix; p++)
         {
-            if(numpix < 1000 && !debug)
+            float sx = view.to_screen_x(P[p].x);
+            float sy = view.to_screen_y(P[p].y);
+            if (splatMode)
+            {
+                splats.add(sx, sy, P[p].L.getR(), P[p].L.getG(), P[p].L.getB());
+                continue;
+            }
+            if (!view.is_visible(sx, sy, radius))
             {
-                filledCircleColor(renderer, SCALE * P[p].x, SCALE * P[p].y, LEDSIZE * 2.5, LEDColor(P[p].L, 0.125));
-                filledCircleColor(renderer, SCALE * P[p].x, SCALE * P[p].y, LEDSIZE * 1.5, LEDColor(P[p].L, 0.25));
+                continue;
             }
-            filledCircleColor(renderer, SCALE * P[p].x, SCALE * P[p].y, LEDSIZE, LEDColor(P[p].L));
+            if(glowLights)
+            {
+                filledCircleColor(renderer, sx, sy, ledsize * 2.5, LEDColor(P[p].L, 0.125));
+                filledCircleColor(renderer, sx, sy, ledsize * 1.5, LEDColor(P[p].L, 0.25));
+            }
+            filledCircleColor(renderer, sx, sy, ledsize, LEDColor(P[p].L));
         }
+        splats.flush(renderer);
 
         SDL_RenderPresent(renderer);
 //        SDL_Delay(5);
-        time++;
     }
 
     SDL_DestroyRenderer(renderer);
@@ -375,6 +466,7 @@ int main(int argc, char* argv[])
     return 0;
 }
 
+int phase_cube1, phase_cube2;
 float pos0 = 0;
 float pos1 = 0;
 float pos2 = 0;
@@ -383,39 +475,91 @@ float vel0 = 0;
 float vel1 = 0;
 float ang0 = 0;
 float ang1 = 0;
+float ang0_prev = 0;
+float ang1_prev = 0;
+float ang0_shown = 0;
+float ang1_shown = 0;
 
+// the cubes used to turn a little with every LED shaded, this many turns per step keep
+// the speed they had on the 215 LEDs of the whale
+#define CUBE_SPIN_LEDS 215
 
-LED shader(float time, vec2 coord, int pixel, int segment)
+// a cube starts over at a place and angle seeded with the time it starts at
+void seed_cube1(double time)
 {
-  bool wal = true;
-
-  float mod_time = fmod(time, 100.);
-  if(mod_time < .01)
-  {
     pos0 = pseudorandom(time);
     pos1 = pseudorandom(time + 1.);
     ang0 = 2.*PI*pseudorandom(2.*time);
-  }
+}
+
+void seed_cube2(double time)
+{
+    pos2 = pseudorandom(7.*time);
+    pos3 = pseudorandom(7.*time + 1.);
+    ang1 = 2.*PI*pseudorandom(3.*time);
+}
+
+void init_pattern()
+{
+    pos0 = pos1 = pos2 = pos3 = 0;
+    ang0 = ang1 = 0;
+
+    phases.clear();
+    phase_cube1 = phases.add(100., 1.);
+    phase_cube2 = phases.add(167., 1., 83.);
+    seed_cube1(0);
+    ang0_prev = ang0_shown = ang0;
+    ang1_prev = ang1_shown = ang1;
+}
+
+void proceed_pattern()
+{
+    long cycles1 = phases.cycles(phase_cube1);
+    long cycles2 = phases.cycles(phase_cube2);
+    ang0_prev = ang0;
+    ang1_prev = ang1;
+    ang0 += CUBE_SPIN_LEDS * 0.0033 * phases.last(phase_cube1) * 1e-4;
+    ang1 -= CUBE_SPIN_LEDS * 0.0021 * phases.last(phase_cube2) * 1e-4;
+    phases.advance(1);
+
+    if (phases.cycles(phase_cube1) != cycles1)
+    {
+        seed_cube1(100. * phases.cycles(phase_cube1));
+        ang0_prev = ang0;
+    }
+    if (phases.cycles(phase_cube2) != cycles2)
+    {
+        seed_cube2(167. * phases.cycles(phase_cube2) - 83.);
+        ang1_prev = ang1;
+    }
+}
+
+// a reseeded cube starts at its new angle instead of sweeping there
+void interpolate_pattern(float alpha)
+{
+    phases.interpolate(alpha);
+    ang0_shown = ang0_prev + alpha * (ang0 - ang0_prev);
+    ang1_shown = ang1_prev + alpha * (ang1 - ang1_prev);
+}
+
+
+LED shader(float time, vec2 coord, int pixel, int segment)
+{
+  bool wal = true;
+
+  float mod_time = phases.get(phase_cube1);
   float edge1 = .01 * mod_time;
-  ang0 += 0.0033 * mod_time * 1e-4;
   float x = coord.x - pos0;
   float y = coord.y - pos1;
-  float xx =  cos(ang0) * x + sin(ang0) * y;
-  float yy = -sin(ang0) * x + cos(ang0) * y;
+  float xx =  cos(ang0_shown) * x + sin(ang0_shown) * y;
+  float yy = -sin(ang0_shown) * x + cos(ang0_shown) * y;
   float intensity = exp(-15. * fabs( min(edge1-fabs(xx), edge1-fabs(yy)) )) * (smoothstep(0,10,mod_time) - smoothstep(80, 100, mod_time));
   LED cube1 = wal ? LED(250, 0, .6 * intensity) : LED(266, .3, intensity);
 
-  float mod_time2 = fmod(time + 83., 167.);
-  if(mod_time2 < .02)
-  {
-    pos2 = pseudorandom(7.*time);
-    pos3 = pseudorandom(7.*time + 1.);
-    ang1 = 2.*PI*pseudorandom(3.*time);
-  }
+  float mod_time2 = phases.get(phase_cube2);
   float edge2 = .004 * (mod_time2);
-  ang1 -= 0.0021 * mod_time2 * 1e-4;
-  x =  cos(ang1) * coord.x + sin(ang1) * coord.y - pos2;
-  y = -sin(ang1) * coord.x + cos(ang1) * coord.y - pos3;
+  x =  cos(ang1_shown) * coord.x + sin(ang1_shown) * coord.y - pos2;
+  y = -sin(ang1_shown) * coord.x + cos(ang1_shown) * coord.y - pos3;
   intensity = exp(-12.4 * fabs( min(edge2-fabs(x), edge2-fabs(y)) )) * (smoothstep(0,10,mod_time) - smoothstep(140, 167, mod_time2));
   LED cube2 = wal ? LED(166, .2, intensity) : LED(111, 0, intensity);
 
@@ -557,3 +701,29 @@ LED shader(float time, vec2 coord, int pixel, int segment)
     }
 }
 */
+
+void shade_frame(std::vector<Pixel> &P, std::vector<Segment> &segments, float time, float width, float height, int selected_segment)
+{
+    // P keeps its storage from frame to frame, it only grows when the layout did
+    int count = 0;
+    for (std::vector<Segment>::iterator iseg = segments.begin(); iseg != segments.end(); ++iseg)
+    {
+        count += iseg->pixels;
+    }
+    P.resize(count);
+    int i = 0;
+    for (std::vector<Segment>::iterator iseg = segments.begin(); iseg != segments.end(); ++iseg)
+    {
+        int segcount = iseg - segments.begin();
+        for (int p = 0; p < iseg->pixels; p++, i++)
+        {
+            Pixel &pixel = P[i];
+            vec2 coord = iseg->get_pixel(p);
+            pixel.x = coord.x;
+            pixel.y = coord.y;
+            pixel.segcount = segcount;
+            vec2 relative_coord = vec2(pixel.x/width, pixel.y/height);
+            pixel.L = shader(time, relative_coord, i, segcount - selected_segment);
+        }
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+
+// uniform grid hashing ids (pixels, segments, ...) by the cells their points fall into.
+// every id remembers its cells, so it can be removed and re-inserted when it is edited
+struct SpatialGrid
+{
+    float cell_size;
+    std::unordered_map<long long, std::vector<int>> cells;
+    std::vector<std::vector<long long>> cells_of;
+    std::vector<int> seen;
+    int query_stamp = 0;
+
+    SpatialGrid(float cell_size) : cell_size(cell_size) {}
+
+    int cell_coord(float v) {return (int)floor(v / cell_size);}
+    long long key(int cx, int cy) {return ((long long)cx << 32) ^ (unsigned int)cy;}
+
+    void insert(int id, float x, float y)
+    {
+        if (id >= cells_of.size())
+        {
+            cells_of.resize(id + 1);
+            seen.resize(id + 1, 0);
+        }
+        long long k = key(cell_coord(x), cell_coord(y));
+        std::vector<long long> &mine = cells_of[id];
+        if (std::find(mine.begin(), mine.end(), k) != mine.end())
+        {
+            return;
+        }
+        mine.push_back(k);
+        cells[k].push_back(id);
+    }
+
+    void remove(int id)
+    {
+        if (id >= cells_of.size())
+        {
+            return;
+        }
+        for (std::vector<long long>::iterator ik = cells_of[id].begin(); ik != cells_of[id].end(); ++ik)
+        {
+            std::vector<int> &cell = cells[*ik];
+            cell.erase(std::remove(cell.begin(), cell.end(), id), cell.end());
+            if (cell.empty())
+            {
+                cells.erase(*ik);
+            }
+        }
+        cells_of[id].clear();
+    }
+
+    void clear()
+    {
+        cells.clear();
+        cells_of.clear();
+        seen.clear();
+    }
+
+    // collects every id with a point in a cell touching the box, each id once
+    void query_box(float x_min, float y_min, float x_max, float y_max, std::vector<int> &found)
+    {
+        found.clear();
+        query_stamp++;
+        int cx_max = cell_coord(x_max);
+        int cy_max = cell_coord(y_max);
+        for (int cx = cell_coord(x_min); cx <= cx_max; cx++)
+        {
+            for (int cy = cell_coord(y_min); cy <= cy_max; cy++)
+            {
+                std::unordered_map<long long, std::vector<int>>::iterator cell = cells.find(key(cx, cy));
+                if (cell == cells.end())
+                {
+                    continue;
+                }
+                for (std::vector<int>::iterator id = cell->second.begin(); id != cell->second.end(); ++id)
+                {
+                    if (seen[*id] != query_stamp)
+                    {
+                        seen[*id] = query_stamp;
+                        found.push_back(*id);
+                    }
+                }
+            }
+        }
+    }
+
+    void query_radius(float x, float y, float radius, std::vector<int> &found)
+    {
+        query_box(x - radius, y - radius, x + radius, y + radius, found);
+    }
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+
+// lock-free ring buffer for exactly one producer and one consumer thread,
+// N has to be a power of two and the queue holds at most N - 1 items
+template<typename T, int N> struct SPSCQueue
+{
+    static_assert((N & (N - 1)) == 0, "SPSCQueue size has to be a power of two");
+
+    T items[N];
+    std::atomic<unsigned> head{0}; // next slot to pop, owned by the consumer
+    std::atomic<unsigned> tail{0}; // next slot to push, owned by the producer
+
+    bool push(const T &item)
+    {
+        unsigned t = tail.load(std::memory_order_relaxed);
+        unsigned next = (t + 1) & (N - 1);
+        if (next == head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        items[t] = item;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        unsigned h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = items[h];
+        head.store((h + 1) & (N - 1), std::memory_order_release);
+        return true;
+    }
+
+    int size()
+    {
+        return (tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire)) & (N - 1);
+    }
+};
+
+#endif
@@ -0,0 +1,155 @@
+#ifndef SYNTHETIC_LAYOUT_H
+#define SYNTHETIC_LAYOUT_H
+
+// generated layouts of any size for the scaling benchmarks, the shipped figures only have
+// a few hundred LEDs. works with the Segment of every program, it only needs the
+// (x, y, to_x, to_y) constructor, the pixels count and move_horizontally / move_vertically.
+// generated segments are moved so that all LEDs lie within [0, width] x [0, height]
+
+#include <string.h>
+#include <vector>
+#include <cmath>
+
+enum SyntheticKind
+{
+    SYNTH_SOUP,     // random short segments all over the place
+    SYNTH_GRID,     // rows of LEDs like shadymatrix_generic, wired as a serpentine
+    SYNTH_STRIP,    // one long strip
+    SYNTH_TREE,     // branching like the satoritree figures
+    SYNTH_KIND_COUNT
+};
+
+const char* synthetic_kind_names[SYNTH_KIND_COUNT] = {"soup", "grid", "strip", "tree"};
+
+int synthetic_kind(const char *name)
+{
+    for (int k = 0; k < SYNTH_KIND_COUNT; k++)
+    {
+        if (!strcmp(name, synthetic_kind_names[k]))
+        {
+            return k;
+        }
+    }
+    return -1;
+}
+
+struct SyntheticExtent
+{
+    float width;
+    float height;
+};
+
+// xorshift, so that generating a layout does not disturb the patterns' random()
+struct SyntheticRandom
+{
+    unsigned state;
+    SyntheticRandom(unsigned seed) : state(seed ? seed : 1) {}
+    unsigned next()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    float uniform() {return (next() & 0xffffff) / 16777216.;}
+    int range(int a, int b) {return a + next() % (b - a + 1);}
+};
+
+struct SyntheticBranch
+{
+    float x, y;
+    float angle;    // radians, 0 is to the right, y grows downwards
+    int pixels;
+};
+
+// adds a segment of exactly n LEDs starting at (x, y) in direction angle
+template<typename S> void synthetic_segment(std::vector<S> &segments, float x, float y, float angle, int n, float pitch)
+{
+    float length = n * pitch;
+    S segment(x, y, x + length * cos(angle), y - length * sin(angle));
+    segment.pixels = n;
+    segments.push_back(segment);
+}
+
+template<typename S> SyntheticExtent generate_layout(std::vector<S> &segments, int kind, int pixels, float pitch, unsigned seed)
+{
+    SyntheticRandom rnd(seed);
+    segments.clear();
+    // about a quarter of the area is covered with LEDs, like the shipped figures
+    float side = 2 * pitch * sqrt((float)pixels);
+    int left = pixels;
+
+    if (kind == SYNTH_SOUP)
+    {
+        while (left > 0)
+        {
+            int n = min(rnd.range(3, 30), left);
+            synthetic_segment(segments, side * rnd.uniform(), side * rnd.uniform(), 2 * M_PI * rnd.uniform(), n, pitch);
+            left -= n;
+        }
+    }
+    else if (kind == SYNTH_GRID)
+    {
+        int row = max((int)sqrt((float)pixels), 1);
+        for (int r = 0; left > 0; r++)
+        {
+            int n = min(row, left);
+            if (r % 2 == 0)
+            {
+                synthetic_segment(segments, 0, r * pitch, 0, n, pitch);
+            }
+            else
+            {
+                synthetic_segment(segments, (row - 1) * pitch, r * pitch, M_PI, n, pitch);
+            }
+            left -= n;
+        }
+    }
+    else if (kind == SYNTH_STRIP)
+    {
+        synthetic_segment(segments, 0, 0, 0, pixels, pitch);
+    }
+    else
+    {
+        // breadth first, so that the budget runs out on a full crown rather than on one long limb
+        std::vector<SyntheticBranch> open;
+        SyntheticBranch trunk = {side / 2, side, M_PI / 2, max(pixels / 20, 4)};
+        open.push_back(trunk);
+        for (int b = 0; b < open.size() && left > 0; b++)
+        {
+            SyntheticBranch branch = open[b];
+            int n = min(branch.pixels, left);
+            synthetic_segment(segments, branch.x, branch.y, branch.angle, n, pitch);
+            left -= n;
+            float end_x = branch.x + n * pitch * cos(branch.angle);
+            float end_y = branch.y - n * pitch * sin(branch.angle);
+            for (int c = 0; c < 2; c++)
+            {
+                float spread = (.3 + .4 * rnd.uniform()) * (c == 0 ? 1 : -1);
+                SyntheticBranch child = {end_x, end_y, branch.angle + spread, max((int)(branch.pixels * (.6 + .2 * rnd.uniform())), 2)};
+                open.push_back(child);
+            }
+        }
+    }
+
+    // move everything into the positive quadrant
+    float min_x = 1e30, min_y = 1e30, max_x = -1e30, max_y = -1e30;
+    for (int s = 0; s < segments.size(); s++)
+    {
+        vec2 first = segments[s].get_pixel(0);
+        vec2 last = segments[s].get_pixel(segments[s].pixels - 1);
+        min_x = min(min_x, min(first.x, last.x));
+        min_y = min(min_y, min(first.y, last.y));
+        max_x = max(max_x, max(first.x, last.x));
+        max_y = max(max_y, max(first.y, last.y));
+    }
+    for (int s = 0; s < segments.size(); s++)
+    {
+        segments[s].move_horizontally(pitch - min_x);
+        segments[s].move_vertically(pitch - min_y);
+    }
+    SyntheticExtent extent = {max_x - min_x + 2 * pitch, max_y - min_y + 2 * pitch};
+    return extent;
+}
+
+#endif
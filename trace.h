@@ -0,0 +1,154 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Chrome trace event export (chrome://tracing, ui.perfetto.dev) of the profiler stages.
+// recording threads only push into their own lock-free queue, a background thread
+// drains the queues and does all the formatting and file writes
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "spsc_queue.h"
+
+#define TRACE_QUEUE_SIZE 16384
+#define TRACE_FLUSH_INTERVAL_MS 20
+
+struct TraceEvent
+{
+    const char *name;
+    char phase;       // 'X' complete span, 's' / 'f' flow start / end
+    long long ts;     // ns, steady clock
+    long long dur;    // ns
+    long frame;
+};
+
+struct TraceBuffer
+{
+    SPSCQueue<TraceEvent, TRACE_QUEUE_SIZE> queue;
+    std::atomic<long> dropped;
+    int tid;
+    TraceBuffer *next;
+
+    TraceBuffer(int tid) : dropped(0), tid(tid), next(NULL) {}
+};
+
+struct Tracer
+{
+    FILE *file = NULL;
+    std::atomic<bool> active;
+    std::atomic<bool> stopping;
+    std::atomic<TraceBuffer*> buffers;
+    std::atomic<int> thread_count;
+    std::atomic<long> frame;
+    std::thread writer;
+    bool first_event = true;
+    long long origin = 0;
+
+    Tracer() : active(false), stopping(false), buffers(NULL), thread_count(0), frame(0) {}
+    ~Tracer() {stop();}
+
+    bool start(const char *path, long long now)
+    {
+        file = fopen(path, "w");
+        if (file == NULL)
+        {
+            printf("could not open trace file %s\n", path);
+            return false;
+        }
+        setvbuf(file, NULL, _IOFBF, 1 << 20);
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        origin = now;
+        stopping = false;
+        active = true;
+        writer = std::thread(&Tracer::run, this);
+        printf("tracing to %s\n", path);
+        return true;
+    }
+
+    void stop()
+    {
+        if (!active)
+        {
+            return;
+        }
+        active = false;
+        stopping = true;
+        writer.join();
+        long dropped = 0;
+        for (TraceBuffer *buffer = buffers.load(); buffer != NULL; buffer = buffer->next)
+        {
+            dropped += buffer->dropped.load();
+        }
+        fprintf(file, "\n]}\n");
+        fclose(file);
+        file = NULL;
+        if (dropped > 0)
+        {
+            printf("trace: %ld events dropped, queues were full\n", dropped);
+        }
+    }
+
+    TraceBuffer& buffer()
+    {
+        thread_local TraceBuffer *mine = NULL;
+        if (mine == NULL)
+        {
+            mine = new TraceBuffer(++thread_count);
+            mine->next = buffers.load();
+            while (!buffers.compare_exchange_weak(mine->next, mine));
+        }
+        return *mine;
+    }
+
+    void record(const char *name, char phase, long long ts, long long dur)
+    {
+        TraceEvent event = {name, phase, ts, dur, frame.load(std::memory_order_relaxed)};
+        TraceBuffer &mine = buffer();
+        if (!mine.queue.push(event))
+        {
+            mine.dropped++;
+        }
+    }
+
+    void write(TraceEvent &event, int tid)
+    {
+        fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%i,\"ts\":%.3f",
+                first_event ? "" : ",\n", event.name, event.phase, tid, 1e-3 * (event.ts - origin));
+        first_event = false;
+        if (event.phase == 'X')
+        {
+            fprintf(file, ",\"dur\":%.3f,\"args\":{\"frame\":%ld}}", 1e-3 * event.dur, event.frame);
+        }
+        else
+        {
+            fprintf(file, ",\"cat\":\"frame\",\"id\":%ld%s}", event.frame, event.phase == 'f' ? ",\"bp\":\"e\"" : "");
+        }
+    }
+
+    void drain()
+    {
+        TraceEvent event;
+        for (TraceBuffer *buffer = buffers.load(std::memory_order_acquire); buffer != NULL; buffer = buffer->next)
+        {
+            while (buffer->queue.pop(event))
+            {
+                write(event, buffer->tid);
+            }
+        }
+    }
+
+    void run()
+    {
+        while (!stopping)
+        {
+            drain();
+            std::this_thread::sleep_for(std::chrono::milliseconds(TRACE_FLUSH_INTERVAL_MS));
+        }
+        drain();
+    }
+};
+
+Tracer tracer;
+
+#endif
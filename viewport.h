@@ -0,0 +1,113 @@
+#ifndef VIEWPORT_H
+#define VIEWPORT_H
+
+#include <vector>
+#include "helper.h"
+
+#define ZOOM_MIN 0.02
+#define ZOOM_MAX 20.
+#define ZOOM_STEP 1.15
+
+// maps layout coordinates (cm) to window pixels, base_scale is the old fixed SCALE
+struct Viewport
+{
+    float base_scale = 1;
+    float zoom = 1;
+    float pan_x = 0;
+    float pan_y = 0;
+    int screen_w = 0;
+    int screen_h = 0;
+
+    Viewport() {}
+    Viewport(float base_scale, int screen_w, int screen_h) : base_scale(base_scale), screen_w(screen_w), screen_h(screen_h) {}
+
+    float scale() {return base_scale * zoom;}
+    float to_screen_x(float x) {return scale() * x + pan_x;}
+    float to_screen_y(float y) {return scale() * y + pan_y;}
+    vec2 to_screen(vec2 v) {return vec2(to_screen_x(v.x), to_screen_y(v.y));}
+    vec2 to_world(float sx, float sy) {return vec2((sx - pan_x) / scale(), (sy - pan_y) / scale());}
+
+    void reset()
+    {
+        zoom = 1;
+        pan_x = 0;
+        pan_y = 0;
+    }
+
+    // zoom around the given screen point, so whatever is under the cursor stays there
+    void zoom_at(float sx, float sy, float factor)
+    {
+        vec2 anchor = to_world(sx, sy);
+        zoom = constrain(zoom * factor, ZOOM_MIN, ZOOM_MAX);
+        pan_x = sx - scale() * anchor.x;
+        pan_y = sy - scale() * anchor.y;
+    }
+
+    void pan(float dx, float dy)
+    {
+        pan_x += dx;
+        pan_y += dy;
+    }
+
+    bool is_visible(float sx, float sy, float radius)
+    {
+        return sx + radius >= 0 && sx - radius < screen_w && sy + radius >= 0 && sy - radius < screen_h;
+    }
+
+    bool is_visible_box(float sx_min, float sy_min, float sx_max, float sy_max)
+    {
+        return sx_max >= 0 && sx_min < screen_w && sy_max >= 0 && sy_min < screen_h;
+    }
+};
+
+// level of detail: when LEDs shrink below one screen pixel, all LEDs falling into the
+// same pixel are averaged into a single splat, so the cost is bounded by the window size
+struct SplatBuffer
+{
+    int w = 0;
+    int h = 0;
+    std::vector<float> sum; // r, g, b, count per screen pixel
+    std::vector<int> touched;
+
+    void resize(int new_w, int new_h)
+    {
+        w = new_w;
+        h = new_h;
+        sum.assign(4 * w * h, 0);
+        touched.clear();
+        touched.reserve(w * h);
+    }
+
+    void add(float sx, float sy, int r, int g, int b)
+    {
+        int x = (int)sx;
+        int y = (int)sy;
+        if (sx < 0 || sy < 0 || x >= w || y >= h)
+        {
+            return;
+        }
+        float *cell = &sum[4 * (y * w + x)];
+        if (cell[3] == 0)
+        {
+            touched.push_back(y * w + x);
+        }
+        cell[0] += r;
+        cell[1] += g;
+        cell[2] += b;
+        cell[3] += 1;
+    }
+
+    void flush(SDL_Renderer *renderer)
+    {
+        for (std::vector<int>::iterator it = touched.begin(); it != touched.end(); ++it)
+        {
+            float *cell = &sum[4 * *it];
+            SDL_SetRenderDrawColor(renderer, cell[0] / cell[3], cell[1] / cell[3], cell[2] / cell[3], 255);
+            SDL_RenderDrawPoint(renderer, *it % w, *it / w);
+            cell[0] = cell[1] = cell[2] = cell[3] = 0;
+        }
+        touched.clear();
+    }
+};
+
+#endif